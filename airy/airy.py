@@ -40,21 +40,44 @@ defaults = dict(
     exit_action   = '_STATE_ACTION_EXIT',
     state_prefix  = '_',
     state_suffix  = '_',
-    static        = 'static'
+    static        = 'static',
+    context_type  = 'MeloContext',
+    context_name  = 'ctx',
+    instance_name = 'sm',
+    transitions   = 'scan',
+    dispatch      = 'functions'
 )
 
+def build_paths(states):
+    # Ancestors of every state, outermost first and ending with the state itself
+    by_id = dict((state['id'], state) for state in states)
+    for state in states:
+        path = [state['id']]
+        while by_id[path[0]]['parent'] != path[0]:
+            path.insert(0, by_id[path[0]]['parent'])
+        state['path'] = path
+
+def build_timers(states):
+    # Only the states with a timer get a slot in the RAM timer array
+    slot = 0
+    for state in states:
+        if state['timer'] != False:
+            state['timer_slot'] = slot
+            slot += 1
+
 def main(argv):
     inputfile  = ''
     outputfile = ''
     statefile  = ''
+    usage      = 'airy.py -i <inputfile> -o <outputfile> -s <statefile> [-t scan|precomputed] [-d functions|switch]'
     try:
-        opts, args = getopt.getopt(argv,"hi:o:s:",["ifile=","ofile=","sfile="])
+        opts, args = getopt.getopt(argv,"hi:o:s:t:d:",["ifile=","ofile=","sfile=","transitions=","dispatch="])
     except getopt.GetoptError:
-        print 'airy.py -i <inputfile> -o <outputfile> -s <statefile>'
+        print usage
         sys.exit(2)
     for opt, arg in opts:
         if opt == '-h':
-            print 'airy.py -i <inputfile> -o <outputfile> -s <statefile>'
+            print usage
             sys.exit()
         elif opt in ("-i", "--ifile"):
             inputfile = arg
@@ -62,16 +85,30 @@ def main(argv):
             outputfile = arg
         elif opt in ("-s", "--sfile"):
             statefile = arg
+        elif opt in ("-t", "--transitions"):
+            defaults['transitions'] = arg
+        elif opt in ("-d", "--dispatch"):
+            defaults['dispatch'] = arg
+
     print 'Input file is "', inputfile
     print 'Output file is "', outputfile
     print 'Satefile file is "', statefile
 
-    states = yaml.load( open(statefile) )
+    chart = yaml.load( open(statefile) )
+    # A chart is either a list of states, or a dictionary of its events and states
+    if isinstance(chart, dict):
+        events = chart.get('events', [])
+        states = chart['states']
+    else:
+        events = []
+        states = chart
+    build_paths(states)
+    build_timers(states)
     
     lookup = TemplateLookup(directories=[ os.path.dirname(os.path.abspath(inspect.getfile(inspect.currentframe()))) ])
     template_file = Template(filename=inputfile, lookup=lookup)
     f = open(outputfile, "w")
-    f.write(template_file.render(states=states, defaults=defaults))
+    f.write(template_file.render(states=states, events=events, defaults=defaults))
     f.close()
 
 if __name__ == "__main__":
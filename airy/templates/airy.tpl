@@ -4,8 +4,15 @@
 /******************************************************************************
 *                              Local Data Types                               *
 ******************************************************************************/
+typedef struct _airy_context ${defaults['context_type']};
+
 <%include file="types.tpl" />
 
+struct _airy_context
+{
+    _state_instance ${defaults['instance_name']};
+};
+
 /******************************************************************************
 *                          Local Function Prototypes                          *
 ******************************************************************************/
@@ -25,18 +32,21 @@
 
 int main(void)
 {
+    static ${defaults['context_type']} context;
+    ${defaults['context_type']} * const ${defaults['context_name']} = &context;
+
     printf("Event: _REQUEST_RECEIVED\n");
-    _current_state = ${defaults['table_name']}[_current_state].function(${defaults['during_action']}, _REQUEST_RECEIVED);
+    ${defaults['context_name']}->${defaults['instance_name']}.current = _state_dispatch(${defaults['context_name']}, _REQUEST_RECEIVED);
     printf("Event: _TX_CONFIRMATION\n");
-    _current_state = ${defaults['table_name']}[_current_state].function(${defaults['during_action']}, _TX_CONFIRMATION);
+    ${defaults['context_name']}->${defaults['instance_name']}.current = _state_dispatch(${defaults['context_name']}, _TX_CONFIRMATION);
     printf("Event: _REQUEST_RECEIVED\n");
-    _current_state = ${defaults['table_name']}[_current_state].function(${defaults['during_action']}, _REQUEST_RECEIVED);
+    ${defaults['context_name']}->${defaults['instance_name']}.current = _state_dispatch(${defaults['context_name']}, _REQUEST_RECEIVED);
     printf("Event: _REQUEST_RECEIVED\n");
-    _current_state = ${defaults['table_name']}[_current_state].function(${defaults['during_action']}, _REQUEST_RECEIVED);
+    ${defaults['context_name']}->${defaults['instance_name']}.current = _state_dispatch(${defaults['context_name']}, _REQUEST_RECEIVED);
     printf("Event: _REQUEST_RECEIVED\n");
-    _current_state = ${defaults['table_name']}[_current_state].function(${defaults['during_action']}, _REQUEST_RECEIVED);
+    ${defaults['context_name']}->${defaults['instance_name']}.current = _state_dispatch(${defaults['context_name']}, _REQUEST_RECEIVED);
     printf("Event: _REQUEST_RECEIVED\n");
-    _current_state = ${defaults['table_name']}[_current_state].function(${defaults['during_action']}, _REQUEST_RECEIVED);
+    ${defaults['context_name']}->${defaults['instance_name']}.current = _state_dispatch(${defaults['context_name']}, _REQUEST_RECEIVED);
     
     return 0;
 }
@@ -1,8 +1,30 @@
+% if defaults['transitions'] == 'precomputed':
+${defaults['state_id_type']} _state_transition(${defaults['context_type']} * const ${defaults['context_name']}, ${defaults['state_id_type']} start_state, ${defaults['state_id_type']} dest_state)
+{
+    const ${defaults['rl_type']} common = _STATE_ROM_READ(${defaults['rl_type']}, &(_common[start_state][dest_state]));
+    ${defaults['rl_type']} depth;
+    
+    /* Exit from start_state outwards, up to the states shared with dest_state */
+    for (depth = _STATE_ROM_READ(${defaults['rl_type']}, &(_depth[start_state])); depth > common; depth--)
+    {
+        (void) _STATE_FUNCTION(_STATE_ROM_READ(${defaults['state_id_type']}, &(_path[start_state][depth - 1u])))(${defaults['context_name']}, ${defaults['exit_action']}, 0);
+    }
+    
+    /* Enter inwards, down to dest_state */
+    for (depth = common; depth < _STATE_ROM_READ(${defaults['rl_type']}, &(_depth[dest_state])); depth++)
+    {
+        (void) _STATE_FUNCTION(_STATE_ROM_READ(${defaults['state_id_type']}, &(_path[dest_state][depth])))(${defaults['context_name']}, ${defaults['entry_action']}, 0);
+    }
+    
+    return dest_state;
+}
+% else:
 ${defaults['bool_type']} _is_parent(const _state_handle * const child, const _state_handle * const parent)
 {
     ${defaults['bool_type']} result = 0;
     
-    if ( (parent->left < child->left) && (parent->right > child->right) )
+    if ( (_STATE_ROM_READ(${defaults['rl_type']}, &(parent->left)) < _STATE_ROM_READ(${defaults['rl_type']}, &(child->left))) &&
+         (_STATE_ROM_READ(${defaults['rl_type']}, &(parent->right)) > _STATE_ROM_READ(${defaults['rl_type']}, &(child->right))) )
     {
         result = ${defaults['true']};
     }
@@ -14,12 +36,12 @@ ${defaults['bool_type']} _is_parent(const _state_handle * const child, const _st
     return result;
 }
 
-${defaults['state_id_type']} _state_transition(${defaults['state_id_type']} start_state, ${defaults['state_id_type']} dest_state)
+${defaults['state_id_type']} _state_transition(${defaults['context_type']} * const ${defaults['context_name']}, ${defaults['state_id_type']} start_state, ${defaults['state_id_type']} dest_state)
 {
     ${defaults['state_id_type']} index;
     
     /* Exit start_state */
-    (void) ${defaults['table_name']}[start_state].function(${defaults['exit_action']}, 0);
+    (void) _STATE_FUNCTION(start_state)(${defaults['context_name']}, ${defaults['exit_action']}, 0);
     
     for (index = start_state; index > 0; index--)
     {
@@ -27,7 +49,7 @@ ${defaults['state_id_type']} _state_transition(${defaults['state_id_type']} star
         {
             if (_is_parent( &(${defaults['table_name']}[dest_state]), &(${defaults['table_name']}[index]) ) == ${defaults['false']})
             {
-                (void) ${defaults['table_name']}[index].function(${defaults['exit_action']}, 0);
+                (void) _STATE_FUNCTION(index)(${defaults['context_name']}, ${defaults['exit_action']}, 0);
             }
             else
             {
@@ -46,7 +68,7 @@ ${defaults['state_id_type']} _state_transition(${defaults['state_id_type']} star
         {
             if (_is_parent( &(${defaults['table_name']}[start_state]), &(${defaults['table_name']}[index]) ) == ${defaults['false']})
             {
-                (void) ${defaults['table_name']}[index].function(${defaults['entry_action']}, 0);
+                (void) _STATE_FUNCTION(index)(${defaults['context_name']}, ${defaults['entry_action']}, 0);
             }
             else
             {
@@ -60,7 +82,72 @@ ${defaults['state_id_type']} _state_transition(${defaults['state_id_type']} star
     }
     
     /* Enter dest_state */
-    (void) ${defaults['table_name']}[dest_state].function(${defaults['entry_action']}, 0);
+    (void) _STATE_FUNCTION(dest_state)(${defaults['context_name']}, ${defaults['entry_action']}, 0);
     
     return dest_state;
+}
+% endif
+
+void _state_tick(${defaults['context_type']} * const ${defaults['context_name']}, const ${defaults['timer_type']} elapsed)
+{
+    ${defaults['context_name']}->${defaults['instance_name']}.now += elapsed;
+}
+
+${defaults['timer_type']} _state_deadline(const ${defaults['context_type']} * const ${defaults['context_name']})
+{
+    ${defaults['timer_type']} result = _STATE_NO_DEADLINE;
+% if len([state for state in states if state['timer'] != False]) > 0:
+    ${defaults['state_id_type']} slot;
+    ${defaults['state_id_type']} index;
+    ${defaults['timer_type']} after;
+    ${defaults['timer_type']} elapsed;
+% if defaults['transitions'] == 'precomputed':
+    ${defaults['rl_type']} depth;
+    const ${defaults['rl_type']} current_depth = _STATE_ROM_READ(${defaults['rl_type']}, &(_depth[${defaults['context_name']}->${defaults['instance_name']}.current]));
+% else:
+    const _state_handle * const current = &(${defaults['table_name']}[${defaults['context_name']}->${defaults['instance_name']}.current]);
+% endif
+
+    /* Time left until the first AFTER() guard of the current state or one of its parents */
+    for (slot = 0; slot < ${len([state for state in states if state['timer'] != False])}; slot++)
+    {
+        index = _STATE_ROM_READ(${defaults['state_id_type']}, &(_timer_state[slot]));
+        after = _STATE_ROM_READ(${defaults['timer_type']}, &(_after[slot]));
+% if defaults['transitions'] == 'precomputed':
+        depth = _STATE_ROM_READ(${defaults['rl_type']}, &(_depth[index]));
+% endif
+
+% if defaults['transitions'] == 'precomputed':
+        if ( (after != 0) && (depth <= current_depth) &&
+             (_STATE_ROM_READ(${defaults['state_id_type']}, &(_path[${defaults['context_name']}->${defaults['instance_name']}.current][depth - 1u])) == index) )
+% else:
+        if ( (after != 0) &&
+             ( (index == ${defaults['context_name']}->${defaults['instance_name']}.current) || (_is_parent(current, &(${defaults['table_name']}[index])) != ${defaults['false']}) ) )
+% endif
+        {
+            elapsed = (${defaults['timer_type']}) (${defaults['context_name']}->${defaults['instance_name']}.now - ${defaults['context_name']}->${defaults['instance_name']}.timer[slot]);
+
+            if (elapsed >= after)
+            {
+                result = 0;
+            }
+            else if ((${defaults['timer_type']}) (after - elapsed) < result)
+            {
+                result = (${defaults['timer_type']}) (after - elapsed);
+            }
+            else
+            {
+                /* Do nothing - a nearer deadline is pending */
+            }
+        }
+        else
+        {
+            /* Do nothing - no timer or not active */
+        }
+    }
+% else:
+    (void) ${defaults['context_name']};
+% endif
+
+    return result;
 }
\ No newline at end of file
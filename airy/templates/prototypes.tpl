@@ -2,9 +2,14 @@
 
 /* States */
 % for state in states:
-${defaults['static']} ${defaults['state_id_type']} ${airy.build_func_name(state['name'])}(const ${defaults['action_type']} action, const ${defaults['event_type']} event);
+${defaults['static']} ${defaults['state_id_type']} ${airy.build_func_name(state['name'])}(${defaults['context_type']} * const ${defaults['context_name']}, const ${defaults['action_type']} action, const ${defaults['event_type']} event);
 % endfor
 
 /* Builtin Functions */
+% if defaults['transitions'] != 'precomputed':
 ${defaults['bool_type']} _is_parent(const _state_handle * const child, const _state_handle * const parent);
-${defaults['state_id_type']} _state_transition(${defaults['state_id_type']} start_state, ${defaults['state_id_type']} dest_state);
\ No newline at end of file
+% endif
+${defaults['state_id_type']} _state_dispatch(${defaults['context_type']} * const ${defaults['context_name']}, const ${defaults['event_type']} event);
+${defaults['state_id_type']} _state_transition(${defaults['context_type']} * const ${defaults['context_name']}, ${defaults['state_id_type']} start_state, ${defaults['state_id_type']} dest_state);
+void _state_tick(${defaults['context_type']} * const ${defaults['context_name']}, const ${defaults['timer_type']} elapsed);
+${defaults['timer_type']} _state_deadline(const ${defaults['context_type']} * const ${defaults['context_name']});
\ No newline at end of file
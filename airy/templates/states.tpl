@@ -6,52 +6,111 @@ after_pattern = re.compile('AFTER\(\d+\)')
 def isafter_gaurd(text):
     return after_pattern.match(text)
 
+def condition(state, transition, defaults, with_event):
+    # The C expression of a transition, its event is left out when the dispatcher has already matched it
+    terms = []
+    if with_event and len(transition.get('event', '')) > 0:
+        terms.append('event == ' + transition['event'])
+    if isafter_gaurd(transition['gaurd']):
+        terms.append('(%s) (%s->%s.now - %s->%s.timer[%d]) >= _%s' % (defaults['timer_type'], defaults['context_name'], defaults['instance_name'], defaults['context_name'], defaults['instance_name'], state['timer_slot'], transition['gaurd']))
+    elif len(transition['gaurd']) > 0:
+        terms.append(transition['gaurd'])
+    if len(terms) == 0:
+        return defaults['true']
+    elif len(terms) == 1:
+        return terms[0]
+    else:
+        return '(' + ') && ('.join(terms) + ')'
+
+def matching(state, event):
+    # Transitions of a state taken on event, those without an event are taken on any
+    return [t for t in state['transitions'] if len(t.get('event', '')) == 0 or t['event'] == event]
+
+def effective(state, event):
+    # Transitions after an unconditional one are never taken, nor are trailing ones that do nothing
+    chain = []
+    for transition in matching(state, event):
+        chain.append(transition)
+        if len(transition['gaurd']) == 0:
+            break
+    while (len(chain) > 0) and (len(chain[-1]['action']) == 0) and (chain[-1]['dest'] == state['id']):
+        chain.pop()
+    return chain
+
+def levels(states, state, event):
+    # The states along the path of state that do something on event, outermost first
+    return [states[id] for id in state['path'] if len(states[id]['during']) > 0 or len(effective(states[id], event)) > 0]
+
+def cases(states, event):
+    # The states that do something on event, those that do the same share a case
+    groups = []
+    for state in states:
+        key = [level['id'] for level in levels(states, state, event)]
+        if len(key) > 0:
+            for group in groups:
+                if group[0] == key:
+                    group[1].append(state['id'])
+                    break
+            else:
+                groups.append((key, [state['id']]))
+    return groups
+
 %>
 
 <%namespace name="airy" file="airy.tpl"/>
 
 % for state in states:
 /* State ${state['name']} */
-${defaults['static']} ${defaults['state_id_type']} ${airy.build_func_name(state['name'])}(const ${defaults['action_type']} action, const ${defaults['event_type']} event)
+${defaults['static']} ${defaults['state_id_type']} ${airy.build_func_name(state['name'])}(${defaults['context_type']} * const ${defaults['context_name']}, const ${defaults['action_type']} action, const ${defaults['event_type']} event)
 {
     ${defaults['state_id_type']} result = ${state['id']};
     
+% if defaults['dispatch'] == 'switch':
+    /* Events are handled by _state_dispatch */
+    (void) event;
+
+% endif
     if (action == ${defaults['entry_action']})
     {
 % if state['timer'] != False:
-        ${defaults['table_name']}[${state['id']}].timer = 0;
+        ${defaults['context_name']}->${defaults['instance_name']}.timer[${state['timer_slot']}] = ${defaults['context_name']}->${defaults['instance_name']}.now;
 % endif
 % if len(state['entry']) > 0:
         ${state['entry']}
 % endif
     }
+% if defaults['dispatch'] != 'switch':
     else if (action == ${defaults['during_action']})
     {
-% if state['timer'] != False:
-        ${defaults['table_name']}[${state['id']}].timer++;
-% endif
+<% ind = '' %>\
 % if state['parent'] != state['id']:
-        (void) ${defaults['table_name']}[${state['parent']}].function(${defaults['during_action']}, event);
+<% ind = '    ' %>\
+        /* The parent state runs first, a transition it takes has precedence */
+        result = _STATE_FUNCTION(${state['parent']})(${defaults['context_name']}, ${defaults['during_action']}, event);
+
+        if (result == ${state['parent']})
+        {
+            result = ${state['id']};
 % endif
 % if len(state['during']) > 0:
-        ${state['during']}
+        ${ind}${state['during']}
 % endif
 % for transition in state['transitions']:
-% if isafter_gaurd(transition['gaurd']):
-        if (${defaults['table_name']}[${state['id']}].timer > _${transition['gaurd']})
-% else:
-        if (${transition['gaurd']})
-% endif
-        {
+        ${ind}${'if' if loop.first else 'else if'} (${condition(state, transition, defaults, True)})
+        ${ind}{
 % if len(transition['action']) > 0:
-            ${transition['action']}
+            ${ind}${transition['action']}
 % endif
 % if transition['dest'] != state['id']:
-            result = _state_transition(${state['id']}, ${transition['dest']});
+            ${ind}result = _state_transition(${defaults['context_name']}, ${defaults['context_name']}->${defaults['instance_name']}.current, ${transition['dest']});
 % endif
-        }
+        ${ind}}
 % endfor
+% if state['parent'] != state['id']:
+        }
+% endif
     }
+% endif
     else if (action == ${defaults['exit_action']})
     {
 % if len(state['exit']) > 0:
@@ -65,4 +124,90 @@ ${defaults['static']} ${defaults['state_id_type']} ${airy.build_func_name(state[
     
     return result;
 }
-% endfor
\ No newline at end of file
+% endfor
+
+% if defaults['dispatch'] == 'switch':
+${defaults['state_id_type']} _state_dispatch(${defaults['context_type']} * const ${defaults['context_name']}, const ${defaults['event_type']} event)
+{
+    ${defaults['state_id_type']} result = ${defaults['context_name']}->${defaults['instance_name']}.current;
+    
+    switch (event)
+    {
+% for event in [e for e in events if len(cases(states, e)) > 0] + [None]:
+% if event is not None:
+        case ${event}:
+% else:
+        default:
+% endif
+        {
+% if len(cases(states, event)) > 0:
+            switch (${defaults['context_name']}->${defaults['instance_name']}.current)
+            {
+% for group in cases(states, event):
+% for id in group[1]:
+                case ${id}:
+% endfor
+                {
+% for level in [states[id] for id in group[0]]:
+% if not loop.first:
+                    if (result == ${defaults['context_name']}->${defaults['instance_name']}.current)
+                    {
+<% ind = '    ' %>\
+% else:
+<% ind = '' %>\
+% endif
+                    ${ind}/* ${level['name']} */
+% if len(level['during']) > 0:
+                    ${ind}${level['during']}
+% endif
+% for transition in effective(level, event):
+% if len(transition['gaurd']) > 0:
+                    ${ind}${'if' if loop.first else 'else if'} (${condition(level, transition, defaults, False)})
+                    ${ind}{
+<% body = ind + '    ' %>\
+% elif not loop.first:
+                    ${ind}else
+                    ${ind}{
+<% body = ind + '    ' %>\
+% else:
+<% body = ind %>\
+% endif
+% if len(transition['action']) > 0:
+                    ${body}${transition['action']}
+% endif
+% if transition['dest'] != level['id']:
+                    ${body}result = _state_transition(${defaults['context_name']}, ${defaults['context_name']}->${defaults['instance_name']}.current, ${transition['dest']});
+% endif
+% if (len(transition['gaurd']) > 0) or (not loop.first):
+                    ${ind}}
+% endif
+% endfor
+% if not loop.first:
+                    }
+% endif
+% endfor
+                    break;
+                }
+% endfor
+                default:
+                {
+                    /* Do nothing - no transition on this event */
+                    break;
+                }
+            }
+% else:
+            /* Do nothing - no transition on this event */
+% endif
+            break;
+        }
+% endfor
+    }
+    
+    return result;
+}
+% else:
+${defaults['state_id_type']} _state_dispatch(${defaults['context_type']} * const ${defaults['context_name']}, const ${defaults['event_type']} event)
+{
+    return _STATE_FUNCTION(${defaults['context_name']}->${defaults['instance_name']}.current)(${defaults['context_name']}, ${defaults['during_action']}, event);
+}
+% endif
\ No newline at end of file
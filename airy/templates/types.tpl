@@ -2,13 +2,39 @@
 #define ${defaults['during_action']} ((${defaults['action_type']}) 1u)
 #define ${defaults['exit_action']}   ((${defaults['action_type']}) 2u)
 #define _AFTER(x) x
+#define _STATE_NO_DEADLINE ((${defaults['timer_type']}) ~((${defaults['timer_type']}) 0u))
+% if len(events) > 0:
 
-typedef ${defaults['state_id_type']} (*_state_func)(const ${defaults['action_type']} action, const ${defaults['event_type']} event);
+typedef enum
+{
+% for event in events:
+    ${event} = ${loop.index}${',' if not loop.last else ''}
+% endfor
+} _state_event;
+% endif
+
+#ifndef _STATE_ROM
+#define _STATE_ROM
+#endif
+#ifndef _STATE_ROM_READ
+#define _STATE_ROM_READ(type, p) (*(p))
+#endif
+#define _STATE_FUNCTION(id) _STATE_ROM_READ(_state_func, &(${defaults['table_name']}[(id)].function))
+
+typedef ${defaults['state_id_type']} (*_state_func)(${defaults['context_type']} * const ${defaults['context_name']}, const ${defaults['action_type']} action, const ${defaults['event_type']} event);
 
 typedef struct
 {
 	_state_func  function;
+% if defaults['transitions'] != 'precomputed':
     ${defaults['rl_type']} left;
     ${defaults['rl_type']} right;
-    ${defaults['timer_type']} timer;
-} _state_handle;
\ No newline at end of file
+% endif
+} _state_handle;
+
+typedef struct
+{
+    ${defaults['state_id_type']} current;
+    ${defaults['timer_type']} now;
+    ${defaults['timer_type']} timer[${max(len([state for state in states if state['timer'] != False]), 1)}];
+} _state_instance;
\ No newline at end of file
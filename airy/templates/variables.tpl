@@ -1,11 +1,83 @@
+<%!
+import re
+
+after_pattern = re.compile('AFTER\((\d+)\)')
+
+def shortest_after(state):
+    values = [int(after_pattern.match(t['gaurd']).group(1)) for t in state['transitions'] if after_pattern.match(t['gaurd'])]
+    return min(values) if len(values) > 0 else 0
+
+def common_depth(source, dest):
+    # Outer states shared by both paths are neither exited nor entered, source and dest always are
+    depth = 0
+    while (depth < len(source['path'])) and (depth < len(dest['path'])) and (source['path'][depth] == dest['path'][depth]):
+        depth += 1
+    return min(depth, len(source['path']) - 1, len(dest['path']) - 1)
+
+def max_depth(states):
+    return max([len(state['path']) for state in states])
+
+%>
 <%namespace name="airy" file="airy.tpl"/>
 
-${defaults['static']} _state_handle ${defaults['table_name']}[${len(states)}] =
+<% timers = [state for state in states if state['timer'] != False] %>\
+% if defaults['transitions'] == 'precomputed':
+${defaults['static']} const _state_handle ${defaults['table_name']}[${len(states)}] _STATE_ROM =
 {
-    /* State Name, Left, Right, Timer */
+    /* State Name */
 % for state in states:
-    /* ${state['id']} */ {${airy.build_func_name(state['name'])}, ${state['left']}, ${state['right']}, 0},
+    /* ${state['id']} */ {${airy.build_func_name(state['name'])}},
 % endfor
 };
+% else:
+${defaults['static']} const _state_handle ${defaults['table_name']}[${len(states)}] _STATE_ROM =
+{
+    /* State Name, Left, Right */
+% for state in states:
+    /* ${state['id']} */ {${airy.build_func_name(state['name'])}, ${state['left']}, ${state['right']}},
+% endfor
+};
+% endif
+% if len(timers) > 0:
 
-${defaults['static']} ${defaults['state_id_type']} _current_state = 0;
\ No newline at end of file
+/* State owning each timer, and its shortest AFTER() guard (0 when it has none) */
+${defaults['static']} const ${defaults['state_id_type']} _timer_state[${len(timers)}] _STATE_ROM =
+{
+% for state in timers:
+    /* ${state['timer_slot']} */ ${state['id']},
+% endfor
+};
+
+${defaults['static']} const ${defaults['timer_type']} _after[${len(timers)}] _STATE_ROM =
+{
+% for state in timers:
+    /* ${state['timer_slot']} */ ${shortest_after(state)},
+% endfor
+};\
+% endif
+% if defaults['transitions'] == 'precomputed':
+
+
+/* Ancestors of each state, outermost first and ending with the state itself */
+${defaults['static']} const ${defaults['state_id_type']} _path[${len(states)}][${max_depth(states)}] _STATE_ROM =
+{
+% for state in states:
+    /* ${state['id']} */ {${', '.join([str(x) for x in state['path'] + [0] * (max_depth(states) - len(state['path']))])}},
+% endfor
+};
+
+${defaults['static']} const ${defaults['rl_type']} _depth[${len(states)}] _STATE_ROM =
+{
+% for state in states:
+    /* ${state['id']} */ ${len(state['path'])},
+% endfor
+};
+
+/* Number of outer states kept active by a transition, indexed by [source][dest] */
+${defaults['static']} const ${defaults['rl_type']} _common[${len(states)}][${len(states)}] _STATE_ROM =
+{
+% for source in states:
+    /* ${source['id']} */ {${', '.join([str(common_depth(source, dest)) for dest in states])}},
+% endfor
+};\
+% endif
\ No newline at end of file
@@ -37,22 +37,31 @@ void MeloTransmitBytes( const uint8_t * const bytes, const uint8_t length )
   MeloTransmitComplete();
 }
 
+static unsigned long last_tick;
+
 void setup()
 {
   Serial.begin(9600);
   MeloInit();
+  last_tick = millis();
 }
 
 void loop()
 {
   uint8_t input_byte;
+  unsigned long now = millis();
+
+  /* report the elapsed time, it drives Melo's timeouts */
+  MeloTick( (uint16_t) (now - last_tick) );
+  last_tick = now;
 
   if ( Serial.available() )
   {
     /* get the new byte */
     input_byte = (uint8_t) Serial.read();
     MeloReceiveByte( input_byte );
-    MeloBackground();
   }
+
+  MeloBackground();
 }
 
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2015 David Sunshine, <http://sunshin.es>
+ *
+ * This file is part of melo.
+ *
+ * melo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * melo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with melo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Host benchmark for the state transitions generated by airy, on a chart of two
+ * branches nested six states deep (airy_deep.yml).
+ *
+ * Generate and run from this directory, once per generation mode:
+ *
+ *     python ../airy/airy.py -i airy_bench.tpl -o airy_bench.c -s airy_deep.yml -t scan -d functions
+ *     gcc -O2 airy_bench.c -o airy_bench && ./airy_bench
+ *
+ * then again with -t precomputed and/or -d switch. All modes must report the same number of
+ * entry/exit calls.
+ */
+
+/******************************************************************************
+*                                   Includes                                  *
+******************************************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+    #define BENCH_CLOCK()              ( (double) __rdtsc() )
+    #define BENCH_UNIT                 "cycles"
+#else
+    #define BENCH_CLOCK()              ( ((double) clock()) * (1.0e9 / CLOCKS_PER_SEC) )
+    #define BENCH_UNIT                 "ns"
+#endif
+
+/******************************************************************************
+*                              Local Data Types                               *
+******************************************************************************/
+#define BENCH_ITERATIONS               1000000ul
+
+typedef struct _airy_context ${defaults['context_type']};
+
+<%include file="templates/types.tpl" />
+
+struct _airy_context
+{
+    _state_instance ${defaults['instance_name']};
+    unsigned long   calls;
+};
+
+/******************************************************************************
+*                          Local Function Prototypes                          *
+******************************************************************************/
+<%include file="templates/prototypes.tpl" />
+
+/******************************************************************************
+*                               Local Variables                               *
+******************************************************************************/
+<%include file="templates/variables.tpl" />
+
+/* Two leaf-to-leaf transitions inside a branch, then one across to the other branch */
+static const uint8_t _events[] = { BENCH_EVENT_SIBLING, BENCH_EVENT_SIBLING, BENCH_EVENT_CROSS };
+
+/******************************************************************************
+*                          Local Function Definitions                         *
+******************************************************************************/
+<%include file="templates/builtins.tpl" />
+
+<%include file="templates/states.tpl" />
+
+int main(void)
+{
+    static ${defaults['context_type']} context;
+    ${defaults['context_type']} * const ${defaults['context_name']} = &context;
+
+    unsigned long iteration;
+    uint8_t       event;
+    double        start;
+    double        elapsed;
+
+    /* Leave IDLE for the first leaf */
+    ${defaults['context_name']}->${defaults['instance_name']}.current = _state_dispatch(${defaults['context_name']}, BENCH_EVENT_CROSS);
+    ${defaults['context_name']}->calls = 0;
+
+    start = BENCH_CLOCK();
+
+    for (iteration = 0; iteration < BENCH_ITERATIONS; iteration++)
+    {
+        for (event = 0; event < sizeof(_events); event++)
+        {
+            ${defaults['context_name']}->${defaults['instance_name']}.current = _state_dispatch(${defaults['context_name']}, _events[event]);
+        }
+    }
+
+    elapsed = BENCH_CLOCK() - start;
+
+    printf("%-12s %-10s %-10s %s/transition\n", "transitions", "dispatch", "calls", BENCH_UNIT);
+    printf("%-12s %-10s %-10lu %.2f\n",
+           "${defaults['transitions']}",
+           "${defaults['dispatch']}",
+           ${defaults['context_name']}->calls,
+           elapsed / ((double) BENCH_ITERATIONS * sizeof(_events)));
+
+    return 0;
+}
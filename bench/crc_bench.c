@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2015 David Sunshine, <http://sunshin.es>
+ *
+ * This file is part of melo.
+ *
+ * melo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * melo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with melo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Host benchmark for the software CRC variants in melo_crc.c.
+ *
+ * Build and run from this directory:
+ *
+ *     gcc -O2 -DMELO_CRC_ALL_VARIANTS -I../melo crc_bench.c ../melo/melo_crc.c -o crc_bench
+ *     ./crc_bench
+ */
+
+/******************************************************************************
+*                                   Includes                                  *
+******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "melo_crc.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+    #define BENCH_CLOCK()              ( (double) __rdtsc() )
+    #define BENCH_UNIT                 "cycles"
+#else
+    #define BENCH_CLOCK()              ( ((double) clock()) * (1.0e9 / CLOCKS_PER_SEC) )
+    #define BENCH_UNIT                 "ns"
+#endif
+
+/******************************************************************************
+*                              Local Data Types                               *
+******************************************************************************/
+#define BENCH_BUFFER_SIZE              4096u
+#define BENCH_ITERATIONS               2000u
+
+typedef uint16_t (*_bench_crc)(const uint8_t * const bytes, const uint16_t length);
+
+typedef struct
+{
+    const char * name;
+    _bench_crc   function;
+    uint16_t     check;
+} _bench_variant;
+
+/******************************************************************************
+*                          Local Function Definitions                         *
+******************************************************************************/
+static uint16_t _crc8_bitwise(const uint8_t * const bytes, const uint16_t length)
+{
+    uint8_t  crc = 0x00u;
+    uint16_t index;
+    uint8_t  bit;
+
+    for (index = 0; index < length; index++)
+    {
+        crc ^= bytes[index];
+
+        for (bit = 0; bit < 8u; bit++)
+        {
+            crc = ((crc & 0x80u) != 0) ? (uint8_t) ((crc << 1u) ^ 0x07u) : (uint8_t) (crc << 1u);
+        }
+    }
+
+    return crc;
+}
+
+static uint16_t _crc8_table256(const uint8_t * const bytes, const uint16_t length)
+{
+    uint8_t  crc = 0x00u;
+    uint16_t index;
+
+    for (index = 0; index < length; index++)
+    {
+        crc = MeloCrc8Table256Update(crc, bytes[index]);
+    }
+
+    return crc;
+}
+
+static uint16_t _crc8_table16(const uint8_t * const bytes, const uint16_t length)
+{
+    uint8_t  crc = 0x00u;
+    uint16_t index;
+
+    for (index = 0; index < length; index++)
+    {
+        crc = MeloCrc8Table16Update(crc, bytes[index]);
+    }
+
+    return crc;
+}
+
+static uint16_t _crc16_table256(const uint8_t * const bytes, const uint16_t length)
+{
+    uint16_t crc = 0xFFFFu;
+    uint16_t index;
+
+    for (index = 0; index < length; index++)
+    {
+        crc = MeloCrc16Table256Update(crc, bytes[index]);
+    }
+
+    return crc;
+}
+
+static uint16_t _crc16_table16(const uint8_t * const bytes, const uint16_t length)
+{
+    uint16_t crc = 0xFFFFu;
+    uint16_t index;
+
+    for (index = 0; index < length; index++)
+    {
+        crc = MeloCrc16Table16Update(crc, bytes[index]);
+    }
+
+    return crc;
+}
+
+static const _bench_variant _variants[] =
+{
+    /* Name,               Function,        Check ("123456789") */
+    { "crc8  bitwise",     _crc8_bitwise,   0x00F4u },
+    { "crc8  table[256]",  _crc8_table256,  0x00F4u },
+    { "crc8  table[16]",   _crc8_table16,   0x00F4u },
+    { "crc16 table[256]",  _crc16_table256, 0x29B1u },
+    { "crc16 table[16]",   _crc16_table16,  0x29B1u },
+};
+
+int main(void)
+{
+    static const uint8_t check_data[9] = { '1', '2', '3', '4', '5', '6', '7', '8', '9' };
+    static uint8_t       buffer[BENCH_BUFFER_SIZE];
+
+    volatile uint16_t sink = 0;
+    uint16_t          index;
+    uint16_t          iteration;
+    uint16_t          variant;
+    double            start;
+    double            elapsed;
+    bool              check_ok;
+    int               result = 0;
+
+    srand(1);
+
+    for (index = 0; index < BENCH_BUFFER_SIZE; index++)
+    {
+        buffer[index] = (uint8_t) rand();
+    }
+
+    printf("%-18s %-8s %s/byte\n", "variant", "check", BENCH_UNIT);
+
+    for (variant = 0; variant < (sizeof(_variants) / sizeof(_variants[0])); variant++)
+    {
+        check_ok = (_variants[variant].function(check_data, sizeof(check_data)) == _variants[variant].check) ? true : false;
+
+        if (check_ok == false)
+        {
+            result = 1;
+        }
+
+        start = BENCH_CLOCK();
+
+        for (iteration = 0; iteration < BENCH_ITERATIONS; iteration++)
+        {
+            sink ^= _variants[variant].function(buffer, BENCH_BUFFER_SIZE);
+        }
+
+        elapsed = BENCH_CLOCK() - start;
+
+        printf("%-18s %-8s %.2f\n",
+               _variants[variant].name,
+               (check_ok != false) ? "ok" : "FAIL",
+               elapsed / ((double) BENCH_BUFFER_SIZE * BENCH_ITERATIONS));
+    }
+
+    (void) sink;
+
+    return result;
+}
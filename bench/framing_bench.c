@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2015 David Sunshine, <http://sunshin.es>
+ *
+ * This file is part of melo.
+ *
+ * melo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * melo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with melo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Host benchmark for the frame overhead of the escaped and the COBS framing: bytes on the
+ * wire per payload byte, when the data is sent in frames of MELO_CFG_MAX_DATA_LENGTH bytes.
+ *
+ * Build and run from this directory:
+ *
+ *     gcc -O2 -I../melo framing_bench.c ../melo/melo_crc.c -lm -o framing_bench
+ *     ./framing_bench [dump ...]
+ *
+ * Each file named on the command line is measured too, e.g. a RAM dump read out with Melo or
+ * a firmware image from avr-objcopy -O binary.
+ */
+
+/******************************************************************************
+*                                   Includes                                  *
+******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+/* The frame serializer is private to melo.c */
+#include "../melo/melo.c"
+
+/******************************************************************************
+*                              Local Data Types                               *
+******************************************************************************/
+#define BENCH_DATA_SIZE                8192u
+
+/******************************************************************************
+*                          Local Function Definitions                         *
+******************************************************************************/
+uint8_t * MeloCreatePointer(const uint32_t address)
+{
+    (void) address;
+
+    return NULL;
+}
+
+void MeloTransmitBytes(const uint8_t * const bytes, const uint8_t length)
+{
+    (void) bytes;
+    (void) length;
+}
+
+static unsigned long _bench_wire_bytes(const uint8_t * const data, const unsigned long length, const bool cobs, const bool crc)
+{
+    static uint8_t  frame[MELO_MAX_FRAME_SIZE];
+    _m_frame_buffer frame_buffer;
+    unsigned long   offset;
+    unsigned long   result = 0;
+
+    frame_buffer.buffer.data = frame;
+    frame_buffer.buffer.size = MELO_MAX_FRAME_SIZE;
+    frame_buffer.crc_present = crc;
+
+    frame_buffer.frame.packet.command.raw_byte      = 0x00;
+    frame_buffer.frame.packet.command.fields.status = MELO_CMD_POSITIVE_RESPONSE;
+    frame_buffer.frame.packet.byte_order            = MELO_CFG_PE_ENDIANESS;
+    frame_buffer.frame.packet.cobs                  = cobs;
+    frame_buffer.frame.packet.ext_flags             = 0;
+
+    for (offset = 0; offset < length; offset += MELO_CFG_MAX_DATA_LENGTH)
+    {
+        frame_buffer.frame.packet.data.data   = (uint8_t *) &(data[offset]);
+        frame_buffer.frame.packet.data.length = (uint8_t) (((length - offset) < MELO_CFG_MAX_DATA_LENGTH) ? (length - offset) : MELO_CFG_MAX_DATA_LENGTH);
+
+        _melo_serialize_frame( &frame_buffer );
+        result += frame_buffer.buffer.length;
+    }
+
+    return result;
+}
+
+static void _bench_report(const char * const name, const uint8_t * const data, const unsigned long length)
+{
+    printf("%-24s %10.3f %10.3f %10.3f %10.3f\n",
+           name,
+           (double) _bench_wire_bytes(data, length, false, false) / (double) length,
+           (double) _bench_wire_bytes(data, length, true,  false) / (double) length,
+           (double) _bench_wire_bytes(data, length, false, true)  / (double) length,
+           (double) _bench_wire_bytes(data, length, true,  true)  / (double) length);
+}
+
+static void _bench_ram_image(uint8_t * const data, const unsigned long length)
+{
+    unsigned long index;
+    float         value;
+    uint16_t      counter;
+
+    /* A typical controller RAM: float signals, small counters and flags, mostly idle buffers */
+    for (index = 0; index < length; index++)
+    {
+        switch ((index / 64u) % 4u)
+        {
+            case 0:
+                value = (float) (100.0 * sin((double) index / 40.0));
+                (void) memcpy(&(data[index]), &value, 1u);
+                break;
+
+            case 1:
+                counter = (uint16_t) (index * 3u);
+                data[index] = ((index & 1u) != 0) ? (uint8_t) (counter >> 8u) : (uint8_t) counter;
+                break;
+
+            case 2:
+                data[index] = ((index % 8u) == 0) ? (uint8_t) (index & 0x03u) : 0x00;
+                break;
+
+            default:
+                data[index] = ((rand() % 4) == 0) ? (uint8_t) rand() : 0x00;
+                break;
+        }
+    }
+}
+
+int main(int argc, char * argv[])
+{
+    static uint8_t data[BENCH_DATA_SIZE];
+    static uint8_t file_data[65536];
+
+    unsigned long index;
+    unsigned long length;
+    FILE        * file;
+    int           arg;
+
+    srand(1);
+
+    printf("%-24s %10s %10s %10s %10s\n", "bytes/payload byte", "escape", "cobs", "escape+crc", "cobs+crc");
+
+    for (index = 0; index < BENCH_DATA_SIZE; index++)
+    {
+        data[index] = (uint8_t) rand();
+    }
+    _bench_report("random", data, BENCH_DATA_SIZE);
+
+    _bench_ram_image(data, BENCH_DATA_SIZE);
+    _bench_report("ram image", data, BENCH_DATA_SIZE);
+
+    (void) memset(data, 0xFF, BENCH_DATA_SIZE);
+    _bench_report("0xFF (escape worst case)", data, BENCH_DATA_SIZE);
+
+    for (arg = 1; arg < argc; arg++)
+    {
+        file = fopen(argv[arg], "rb");
+
+        if (file != NULL)
+        {
+            length = (unsigned long) fread(file_data, 1u, sizeof(file_data), file);
+            (void) fclose(file);
+
+            if (length > 0)
+            {
+                _bench_report(argv[arg], file_data, length);
+            }
+            else
+            {
+                /* Do nothing - empty file */
+            }
+        }
+        else
+        {
+            printf("%-24s cannot be opened\n", argv[arg]);
+        }
+    }
+
+    return 0;
+}
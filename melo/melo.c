@@ -22,6 +22,7 @@
 ******************************************************************************/
 #include "melo.h"
 #include "melo_priv.h"
+#include <string.h>
 
 /*[[[cog
 import cog
@@ -51,16 +52,42 @@ MakoSafeInclude("templates/types.tpl")
 #define _STATE_ACTION_DURING ((uint8_t) 1u)
 #define _STATE_ACTION_EXIT   ((uint8_t) 2u)
 #define _AFTER(x) x
+#define _STATE_NO_DEADLINE ((uint16_t) ~((uint16_t) 0u))
 
-typedef uint16_t (*_state_func)(const uint8_t action, const uint8_t event);
+typedef enum
+{
+    MELO_EVENT_IDLE = 0,
+    MELO_EVENT_REQUEST_RECEIVED = 1,
+    MELO_EVNET_TX_CONFIRMATION = 2,
+    MELO_EVENT_DAQ_TRIGGER = 3,
+    MELO_EVENT_TIMEOUT = 4,
+    MELO_EVENT_SEGMENT = 5,
+    MELO_EVENT_OPERATION_DONE = 6
+} _state_event;
+
+#ifndef _STATE_ROM
+#define _STATE_ROM
+#endif
+#ifndef _STATE_ROM_READ
+#define _STATE_ROM_READ(type, p) (*(p))
+#endif
+#define _STATE_FUNCTION(id) _STATE_ROM_READ(_state_func, &(_table[(id)].function))
+
+typedef uint16_t (*_state_func)(MeloContext * const ctx, const uint8_t action, const uint8_t event);
 
 typedef struct
 {
 	_state_func  function;
     uint8_t left;
     uint8_t right;
-    uint16_t timer;
 } _state_handle;
+
+typedef struct
+{
+    uint16_t current;
+    uint16_t now;
+    uint16_t timer[6];
+} _state_instance;
 /*[[[end]]]*/
 
 typedef struct
@@ -80,24 +107,172 @@ typedef struct
     };
 } _melo_data_ptr;
 
+struct _m_context
+{
+    const MeloCallbacks * callbacks;
+    void                * user_data;
+    _state_instance       sm;
+
+    _m_frame_buffer       wait_frame;
+    _m_frame_buffer       send_frame;
+    _m_frame_buffer       recv_frames[MELO_CFG_RX_FRAME_COUNT];
+    _m_frame_buffer     * recv_frame;
+    volatile uint8_t      recv_head;
+    volatile uint8_t      recv_tail;
+    bool                  recv_cobs;
+
+    uint8_t               recv_frame_buffer[MELO_CFG_RX_FRAME_COUNT][MELO_MAX_FRAME_SIZE];
+    uint8_t               send_frame_buffer[MELO_MAX_FRAME_SIZE];
+    uint8_t               wait_frame_buffer[MELO_MAX_WAIT_FRAME_SIZE];
+
+    uint8_t               send_packet_buffer[MELO_CFG_MAX_DATA_LENGTH];
+    uint8_t               wait_packet_buffer;
+
+    _m_event_queue        events;
+    volatile uint16_t     ticks;
+    uint8_t               reply;
+    _m_operation          operation;
+
+#ifdef MELO_CFG_MODE_MASTER
+    _m_outstanding        outstanding[MELO_CFG_MAX_OUTSTANDING];
+    uint8_t               next_tag;
+#ifdef MELO_CFG_DIRECT_RESPONSE
+    bool                  direct;
+#endif
+#endif
+
+#ifdef MELO_CFG_DAQ
+    _m_frame_buffer       daq_frame;
+    _m_daq_list           daq_lists[MELO_CFG_DAQ_LISTS];
+    volatile uint8_t      daq_pending;
+    uint8_t               daq_counter[MELO_CFG_DAQ_LISTS];
+#endif
+
+#ifdef MELO_CFG_SEGMENT
+    _m_frame_buffer       segment_frame;
+    _m_segment            segment;
+#endif
+
+#if defined(MELO_CFG_CHECKSUM) || defined(MELO_CFG_BLOCK_HASH)
+    _m_checksum           checksum;
+#endif
+
+#ifdef MELO_CFG_MEMORY_OPS
+    _m_memory             memory;
+#endif
+
+#ifdef MELO_CFG_WAIT
+    _m_wait               wait;
+#endif
+};
+
 /******************************************************************************
 *                          Local Function Prototypes                          *
 ******************************************************************************/
-static uint8_t  _get_event(void);
-static void     _init_event_stack(void);
-static void     _melo_create_cmd_byte(uint8_t * const b, const uint8_t cmd_type);
+static void     _melo_init_ctx(MeloContext * const ctx, const MeloCallbacks * const callbacks, void * const user_data);
+static uint8_t  _get_event(MeloContext * const ctx);
+static void     _melo_dispatch_events(MeloContext * const ctx);
+static void     _melo_create_cmd_byte(uint8_t * const b, const uint8_t cmd_type, const uint8_t byte_order);
 static void     _melo_create_r(uint8_t * const b);
-static uint32_t _melo_esafe_uint32(const uint8_t * const bytes, const uint8_t pe, const uint8_t he);
-static uint16_t _melo_esafe_uint16(const uint8_t * const bytes, const uint8_t pe, const uint8_t he);
-static void     _melo_frame_handler(const _m_frame * const frame, const bool crc_present);
-static void     _melo_packet_handler(const _m_packet * const packet);
+static void     _melo_copy_value(uint8_t * const dest, const uint8_t * const src, const uint8_t size);
+static bool     _melo_daq_pending(const MeloContext * const ctx);
+static void     _melo_daq_notify_pending(MeloContext * const ctx);
+static void     _melo_daq_transmit(MeloContext * const ctx);
+static bool     _melo_segment_pending(const MeloContext * const ctx);
+static void     _melo_segment_notify_pending(MeloContext * const ctx);
+static void     _melo_segment_transmit(MeloContext * const ctx);
+static void     _melo_segment_tick(MeloContext * const ctx, const uint16_t elapsed);
+static uint16_t _melo_segment_deadline(const MeloContext * const ctx, const uint16_t deadline);
+static void     _melo_wait_tick(MeloContext * const ctx, const uint16_t elapsed);
+#ifdef MELO_OPERATION_ENABLED
+static void     _melo_operation_start(MeloContext * const ctx, const _m_operation_step step);
+#ifdef MELO_CFG_FLASH
+static void     _melo_operation_cancel(MeloContext * const ctx);
+#endif
+static void     _melo_operation_complete(MeloContext * const ctx, const bool success);
+#endif
+static bool     _melo_operation_pending(const MeloContext * const ctx);
+static bool     _melo_operation_done(const MeloContext * const ctx);
+static void     _melo_operation_notify_done(MeloContext * const ctx);
+static void     _melo_operation_step(MeloContext * const ctx);
+static uint16_t _melo_operation_deadline(const MeloContext * const ctx, const uint16_t deadline);
+static void     _melo_operation_respond(MeloContext * const ctx);
+static MELO_INLINE uint32_t _melo_esafe_uint32(const uint8_t * const bytes, const uint8_t pe, const uint8_t he);
+static MELO_INLINE uint16_t _melo_esafe_uint16(const uint8_t * const bytes, const uint8_t pe, const uint8_t he);
+static void     _melo_esafe_copy(uint8_t * const dest, const uint8_t * const src, const uint8_t length, const uint8_t width, const uint8_t pe, const uint8_t he);
+#ifdef MELO_CFG_MODE_MASTER
+static uint8_t  _melo_build_request(uint8_t * buffer, const uint8_t service, const uint8_t subfunction, const MeloList * const request_data, const bool use_crc, const uint8_t ext_flags, const uint8_t tag);
+static bool     _melo_match_tag(MeloContext * const ctx, const _m_packet * const packet, const bool release);
+#endif
+static void     _melo_frame_handler(MeloContext * const ctx, const _m_frame * const frame, const bool crc_present);
+static void     _melo_packet_handler(MeloContext * const ctx, const _m_packet * const packet, const bool crc_present);
 static void     _melo_restore_r(uint8_t * const b);
-static void     _melo_rx_byte(_m_frame_buffer * const frame_buffer, const uint8_t byte);
+static void     _melo_process_frame(MeloContext * const ctx);
+static bool     _melo_rx_byte(_m_frame_buffer * const frame_buffer, const uint8_t byte);
+static bool     _melo_rx_cobs_byte(_m_frame_buffer * const frame_buffer, const uint8_t byte);
+static void     _melo_rx_store(_m_frame_buffer * const frame_buffer, const uint8_t byte);
+static bool     _melo_rx_unpack(_m_frame_buffer * const frame_buffer);
+static void     _melo_rx_notify_pending(MeloContext * const ctx);
+static bool     _melo_rx_pending(const MeloContext * const ctx);
+static void     _melo_receive(MeloContext * const ctx, const uint8_t byte);
 static void     _melo_serialize_frame(_m_frame_buffer * const frame_buffer);
-static uint8_t  _melo_service_handler(const _m_packet * const packet);
-static void     _notify_event(const uint8_t event);
-static bool     _service_read_write(const _m_packet * const request, _m_packet * const response);
-static bool     _service_NULL(const _m_packet * const request, _m_packet * const response);
+static void     _melo_cobs_encode(_m_frame_buffer * const frame_buffer);
+static uint8_t  _melo_service_handler(MeloContext * const ctx, const _m_packet * const packet, const bool crc_present);
+static void     _melo_transmit_frame(MeloContext * const ctx, const _m_frame_buffer * const frame_buffer);
+static void     _notify_event(MeloContext * const ctx, const uint8_t event);
+static bool     _service_read_write(MeloContext * const ctx, const MeloMessage * const request, MeloMessage * const response);
+static bool     _service_read_write_block(const MeloMessage * const request, MeloMessage * const response, uint8_t * const address_ptr);
+static bool     _service_gather_read(MeloContext * const ctx, const MeloMessage * const request, MeloMessage * const response);
+#ifdef MELO_CFG_DAQ
+static bool     _service_daq(MeloContext * const ctx, const MeloMessage * const request, MeloMessage * const response);
+static bool     _service_daq_set_list(MeloContext * const ctx, const MeloMessage * const request);
+#endif
+#ifdef MELO_CFG_SEGMENT
+static bool     _service_transfer(MeloContext * const ctx, const MeloMessage * const request, MeloMessage * const response);
+static bool     _service_transfer_first(MeloContext * const ctx, const MeloMessage * const request, MeloMessage * const response);
+static bool     _service_transfer_consecutive(MeloContext * const ctx, const MeloMessage * const request, MeloMessage * const response);
+static bool     _service_transfer_flow_control(MeloContext * const ctx, const MeloMessage * const request, MeloMessage * const response);
+static void     _service_transfer_flow(MeloMessage * const response);
+#endif
+#ifdef MELO_CFG_FLASH
+static bool     _service_flash(MeloContext * const ctx, const MeloMessage * const request, MeloMessage * const response);
+#endif
+#ifdef MELO_CFG_CHECKSUM
+static bool     _service_checksum(MeloContext * const ctx, const MeloMessage * const request, MeloMessage * const response);
+#endif
+#ifdef MELO_CFG_BLOCK_HASH
+static bool     _service_block_hash(MeloContext * const ctx, const MeloMessage * const request, MeloMessage * const response);
+#endif
+#if defined(MELO_CFG_CHECKSUM) || defined(MELO_CFG_BLOCK_HASH)
+static void     _melo_checksum_start(MeloContext * const ctx, const MeloMessage * const request, const uint32_t length, const uint32_t block);
+static void     _melo_checksum_step(MeloContext * const ctx);
+#endif
+#ifdef MELO_CFG_MEMORY_OPS
+static bool     _service_memory(MeloContext * const ctx, const MeloMessage * const request, MeloMessage * const response);
+static bool     _service_memory_modify(MeloContext * const ctx, const MeloMessage * const request, MeloMessage * const response);
+static uint16_t _melo_memory_chunk(const _m_memory * const memory);
+static void     _melo_memory_fill_step(MeloContext * const ctx);
+static void     _melo_memory_copy_step(MeloContext * const ctx);
+static void     _melo_memory_search_step(MeloContext * const ctx);
+#endif
+#ifdef MELO_CFG_WAIT
+static bool     _service_wait(MeloContext * const ctx, const MeloMessage * const request, MeloMessage * const response);
+static uint32_t _melo_wait_value(const uint8_t * const bytes, const uint8_t width, const uint8_t pe, const uint8_t he);
+static void     _melo_wait_step(MeloContext * const ctx);
+#endif
+
+#ifdef MELO_CFG_DEFAULT_CONTEXT
+static uint8_t * _default_create_pointer(MeloContext * const ctx, const uint32_t address);
+static void      _default_transmit_bytes(MeloContext * const ctx, const uint8_t * const bytes, const uint8_t length);
+#ifdef MELO_CFG_MODE_MASTER
+static void      _default_request_bytes(MeloContext * const ctx, const uint8_t num);
+static void      _default_receive_response(MeloContext * const ctx, const uint8_t tag, const uint8_t service, const uint8_t subfunction, const uint8_t * const bytes, const uint8_t length, bool postive, const uint8_t byte_order);
+#endif
+#ifdef MELO_CFG_FLASH
+static bool      _default_flash_erase(MeloContext * const ctx, const uint32_t address, const uint32_t length);
+static bool      _default_flash_write(MeloContext * const ctx, const uint32_t address, const uint8_t * const bytes, const uint8_t length);
+#endif
+#endif
 
 /*[[[cog
 MakoSafeInclude("templates/prototypes.tpl")
@@ -105,14 +280,22 @@ MakoSafeInclude("templates/prototypes.tpl")
 
 
 /* States */
-static uint16_t _IDLE_(const uint8_t action, const uint8_t event);
-static uint16_t _RESP_PROC_(const uint8_t action, const uint8_t event);
-static uint16_t _RESP_PEND_(const uint8_t action, const uint8_t event);
-static uint16_t _TX_PEND_(const uint8_t action, const uint8_t event);
+static uint16_t _IDLE_(MeloContext * const ctx, const uint8_t action, const uint8_t event);
+static uint16_t _RESP_PROC_(MeloContext * const ctx, const uint8_t action, const uint8_t event);
+static uint16_t _RESP_PEND_(MeloContext * const ctx, const uint8_t action, const uint8_t event);
+static uint16_t _TX_PEND_(MeloContext * const ctx, const uint8_t action, const uint8_t event);
+static uint16_t _DAQ_TX_(MeloContext * const ctx, const uint8_t action, const uint8_t event);
+static uint16_t _SEG_TX_(MeloContext * const ctx, const uint8_t action, const uint8_t event);
+static uint16_t _OP_BUSY_(MeloContext * const ctx, const uint8_t action, const uint8_t event);
+static uint16_t _OP_PEND_(MeloContext * const ctx, const uint8_t action, const uint8_t event);
+static uint16_t _OP_TX_(MeloContext * const ctx, const uint8_t action, const uint8_t event);
 
 /* Builtin Functions */
 bool _is_parent(const _state_handle * const child, const _state_handle * const parent);
-uint16_t _state_transition(uint16_t start_state, uint16_t dest_state);
+uint16_t _state_dispatch(MeloContext * const ctx, const uint8_t event);
+uint16_t _state_transition(MeloContext * const ctx, uint16_t start_state, uint16_t dest_state);
+void _state_tick(MeloContext * const ctx, const uint16_t elapsed);
+uint16_t _state_deadline(const MeloContext * const ctx);
 /*[[[end]]]*/
 
 /******************************************************************************
@@ -123,89 +306,279 @@ MakoSafeInclude("templates/variables.tpl")
 ]]]*/
 
 
-static _state_handle _table[4] =
+
+static const _state_handle _table[9] _STATE_ROM =
 {
-    /* State Name, Left, Right, Timer */
-    /* 0 */ {_IDLE_, 1, 2, 0},
-    /* 1 */ {_RESP_PROC_, 3, 8, 0},
-    /* 2 */ {_RESP_PEND_, 4, 5, 0},
-    /* 3 */ {_TX_PEND_, 6, 7, 0},
+    /* State Name, Left, Right */
+    /* 0 */ {_IDLE_, 1, 2},
+    /* 1 */ {_RESP_PROC_, 3, 8},
+    /* 2 */ {_RESP_PEND_, 4, 5},
+    /* 3 */ {_TX_PEND_, 6, 7},
+    /* 4 */ {_DAQ_TX_, 9, 10},
+    /* 5 */ {_SEG_TX_, 11, 12},
+    /* 6 */ {_OP_BUSY_, 13, 14},
+    /* 7 */ {_OP_PEND_, 15, 16},
+    /* 8 */ {_OP_TX_, 17, 18},
 };
 
-static uint16_t _current_state = 0;
-/*[[[end]]]*/
+/* State owning each timer, and its shortest AFTER() guard (0 when it has none) */
+static const uint16_t _timer_state[6] _STATE_ROM =
+{
+    /* 0 */ 1,
+    /* 1 */ 4,
+    /* 2 */ 5,
+    /* 3 */ 6,
+    /* 4 */ 7,
+    /* 5 */ 8,
+};
 
-static uint8_t recv_frame_buffer[MELO_MAX_FRAME_SIZE]        = {0};
-static uint8_t send_frame_buffer[MELO_MAX_FRAME_SIZE]        = {0};
-static uint8_t wait_frame_buffer[MELO_MAX_WAIT_FRAME_SIZE]   = {0};
+static const uint16_t _after[6] _STATE_ROM =
+{
+    /* 0 */ 500,
+    /* 1 */ 500,
+    /* 2 */ 500,
+    /* 3 */ 250,
+    /* 4 */ 500,
+    /* 5 */ 500,
+};
+/*[[[end]]]*/
 
-static uint8_t recv_packet_buffer[MELO_CFG_MAX_DATA_LENGTH]  = {0};
-static uint8_t send_packet_buffer[MELO_CFG_MAX_DATA_LENGTH]  = {0};
-static uint8_t wait_packet_buffer;
+static MeloContext _m_contexts[MELO_CFG_MAX_CONTEXTS];
+static bool        _m_contexts_used[MELO_CFG_MAX_CONTEXTS];
 
-static _m_frame_buffer wait_frame;
-static _m_frame_buffer send_frame;
-static _m_frame_buffer recv_frame;
+#ifdef MELO_CFG_DEFAULT_CONTEXT
+/* Kept out of the pool, so the default functions always have a context */
+static MeloContext _m_default_context;
 
-static uint8_t  _m_event_stack_data[MELO_CFG_MAX_STACK_SIZE] = {0};
-static MeloList _m_event_stack;
+static const MeloCallbacks _m_default_callbacks =
+{
+    _default_create_pointer,
+    _default_transmit_bytes,
+#ifdef MELO_CFG_MODE_MASTER
+    _default_request_bytes,
+    _default_receive_response,
+    NULL,
+#endif
+#ifdef MELO_CFG_FLASH
+    _default_flash_erase,
+    _default_flash_write,
+#endif
+};
+#endif
 
-static const _m_service service_table[8] =
+/* Melo's own services, indexed by service ID; services left out of the build are NULL */
+static const MeloService MELO_CFG_ROM _m_builtin_services[MELO_BUILTIN_SERVICES] =
 {
     /* 0 */ _service_read_write,
-    /* 1 */ _service_NULL,
-    /* 2 */ _service_NULL,
-    /* 3 */ _service_NULL,
-    /* 4 */ _service_NULL,
-    /* 5 */ _service_NULL,
-    /* 6 */ _service_NULL,
-    /* 7 */ _service_NULL,
+    /* 1 */ _service_gather_read,
+#ifdef MELO_CFG_DAQ
+    /* 2 */ _service_daq,
+#else
+    /* 2 */ NULL,
+#endif
+#ifdef MELO_CFG_SEGMENT
+    /* 3 */ _service_transfer,
+#else
+    /* 3 */ NULL,
+#endif
+#ifdef MELO_CFG_FLASH
+    /* 4 */ _service_flash,
+#else
+    /* 4 */ NULL,
+#endif
+#ifdef MELO_CFG_CHECKSUM
+    /* 5 */ _service_checksum,
+#else
+    /* 5 */ NULL,
+#endif
+#ifdef MELO_CFG_BLOCK_HASH
+    /* 6 */ _service_block_hash,
+#else
+    /* 6 */ NULL,
+#endif
+#ifdef MELO_CFG_MEMORY_OPS
+    /* 7 */ _service_memory,
+#else
+    /* 7 */ NULL,
+#endif
+#ifdef MELO_CFG_WAIT
+    /* 8 */ _service_wait,
+#else
+    /* 8 */ NULL,
+#endif
 };
 
+/* Services registered by the application, indexed by service ID; they take precedence over the built-in ones */
+static MeloService _m_services[MELO_CFG_NUM_SERVICES];
+
 /******************************************************************************
 *                        Exported Function Definitions                        *
 ******************************************************************************/
-void MeloTransmitComplete(void)
+void MeloTransmitCompleteCtx(MeloContext * const ctx)
 {
-    _notify_event(MELO_EVNET_TX_CONFIRMATION);
+    _notify_event(ctx, MELO_EVNET_TX_CONFIRMATION);
 }
 
-void MeloReceiveBytes(const uint8_t * const bytes, const uint8_t num)
+void MeloReceiveBytesCtx(MeloContext * const ctx, const uint8_t * const bytes, const uint8_t num)
 {
     uint8_t i;
 
     for (i = 0; i < num; i++)
     {
-        _melo_rx_byte( &recv_frame, bytes[i] );
+        _melo_receive( ctx, bytes[i] );
     }
 }
 
-void MeloReceiveByte( const uint8_t byte )
+void MeloReceiveByteCtx(MeloContext * const ctx, const uint8_t byte)
+{
+    _melo_receive( ctx, byte );
+}
+
+void * MeloGetUserData(const MeloContext * const ctx)
+{
+    return ctx->user_data;
+}
+
+uint8_t MeloGetEventOverflows(const MeloContext * const ctx)
+{
+    return ctx->events.overflow;
+}
+
+bool MeloRegisterService(const uint8_t service, const MeloService handler)
 {
-    _melo_rx_byte( &recv_frame, byte );
+    bool result = false;
+
+    if (service < MELO_CFG_NUM_SERVICES)
+    {
+        _m_services[service] = handler;
+        result = true;
+    }
+    else
+    {
+        /* Error - increase MELO_CFG_NUM_SERVICES */
+    }
+
+    return result;
 }
 
 #ifdef MELO_CFG_MODE_MASTER
 uint8_t MeloServiceRequestBuilder(uint8_t * buffer, const uint8_t service, const uint8_t subfunction, const MeloList * const request_data, const bool use_crc)
 {
-    _m_frame_buffer tx_frame;
+    return _melo_build_request(buffer, service, subfunction, request_data, use_crc, 0, 0);
+}
 
-    tx_frame.frame.packet.command.raw_byte           = 0x00;
-    tx_frame.frame.packet.command.fields.service     = service;
-    tx_frame.frame.packet.command.fields.subfunction = subfunction;
-    tx_frame.frame.packet.command.fields.status      = MELO_CMD_REQUEST_RESPONSE;
-    tx_frame.frame.packet.byte_order                 = MELO_CFG_PE_ENDIANESS;
+uint8_t MeloTaggedRequestBuilder(MeloContext * const ctx, uint8_t * buffer, const uint8_t service, const uint8_t subfunction, const MeloList * const request_data, const bool use_crc, uint8_t * const tag)
+{
+    uint8_t length = 0;
+    uint8_t slot;
+    uint8_t ext_flags;
 
-    tx_frame.buffer.data              = buffer;
-    tx_frame.frame.packet.data.length = request_data->length;
-    tx_frame.frame.packet.data.data   = request_data->data;
-    tx_frame.crc_present              = use_crc;
+    for (slot = 0; (slot < MELO_CFG_MAX_OUTSTANDING) && (ctx->outstanding[slot].used != false); slot++)
+    {
+        /* Do nothing - searching for a free slot */
+    }
 
-    _melo_serialize_frame( &tx_frame );
+    if (slot < MELO_CFG_MAX_OUTSTANDING)
+    {
+        ctx->outstanding[slot].used = true;
+        ctx->outstanding[slot].tag  = ctx->next_tag;
 
-    return tx_frame.buffer.length;
+        ctx->next_tag++;
+        if (ctx->next_tag == MELO_TAG_NONE)
+        {
+            ctx->next_tag = 0;
+        }
+        else
+        {
+            /* Do nothing - tag is valid */
+        }
+
+        ext_flags = BIT_MASK(MELO_EXT_TAG_BIT_POS);
+
+#ifdef MELO_CFG_DIRECT_RESPONSE
+        if (ctx->direct != false)
+        {
+            BIT_SET(ext_flags, MELO_EXT_DIRECT_BIT_POS);
+        }
+        else
+        {
+            /* Do nothing - the slave announces the response */
+        }
+#endif
+
+        *tag   = ctx->outstanding[slot].tag;
+        length = _melo_build_request(buffer, service, subfunction, request_data, use_crc, ext_flags, *tag);
+    }
+    else
+    {
+        /* Error - too many outstanding requests, increase MELO_CFG_MAX_OUTSTANDING */
+    }
+
+    return length;
+}
+
+void MeloCancelRequest(MeloContext * const ctx, const uint8_t tag)
+{
+    uint8_t slot;
+
+    for (slot = 0; slot < MELO_CFG_MAX_OUTSTANDING; slot++)
+    {
+        if ( (ctx->outstanding[slot].used != false) && (ctx->outstanding[slot].tag == tag) )
+        {
+            ctx->outstanding[slot].used = false;
+        }
+        else
+        {
+            /* Do nothing - different request */
+        }
+    }
+}
+
+#ifdef MELO_CFG_DIRECT_RESPONSE
+void MeloSetDirectResponse(MeloContext * const ctx, const bool enable)
+{
+    ctx->direct = enable;
+}
+#endif
+
+#ifdef MELO_CFG_BLOCK_HASH
+uint8_t MeloBlockHashDiff(const uint8_t * const mirror, const uint32_t length, const uint16_t block_size, const uint8_t * const hashes, const uint8_t num_hashes, uint8_t * const changed)
+{
+    uint8_t  num_changed = 0;
+    uint32_t offset      = 0;
+    uint32_t end;
+    uint32_t crc;
+    uint32_t hash;
+    uint8_t  block;
+
+    for (block = 0; (block < num_hashes) && (offset < length) && (block_size != 0); block++)
+    {
+        end = ( (length - offset) < block_size ) ? length : (offset + block_size);
+        crc = MELO_CRC32_INIT;
+
+        for (; offset < end; offset++)
+        {
+            crc = MeloCrc32Table16Update(crc, mirror[offset]);
+        }
+
+        /* The slave answers in the byte order of the request, i.e. this master's */
+        (void) memcpy(&hash, &(hashes[block * MELO_CHECKSUM_SIZE]), MELO_CHECKSUM_SIZE);
+
+        if (hash != (uint32_t) (crc ^ MELO_CRC32_XOROUT))
+        {
+            BIT_SET(changed[block / 8u], block % 8u);
+            num_changed++;
+        }
+        else
+        {
+            BIT_CLEAR(changed[block / 8u], block % 8u);
+        }
+    }
+
+    return num_changed;
 }
 #endif
+#endif
 
 #ifndef MELO_COMPILE_TIME_ENDIAN
 uint8_t MeloGetEndianess(void)
@@ -232,225 +605,1999 @@ uint8_t MeloGetEndianess(void)
 }
 #endif
 
-void MeloInit(void)
+MeloContext * MeloInitCtx(const MeloCallbacks * const callbacks, void * const user_data)
 {
-    wait_frame.buffer.data = &wait_frame_buffer[0];
-    wait_frame.buffer.size = MELO_MAX_WAIT_FRAME_SIZE;
-    wait_frame.frame.packet.data.data = &wait_packet_buffer;
-    wait_frame.frame.packet.data.size = MELO_WAIT_DATA_SIZE;
-
-    send_frame.buffer.data = &send_frame_buffer[0];
-    send_frame.buffer.size = MELO_MAX_FRAME_SIZE;
-    send_frame.frame.packet.data.data = &send_packet_buffer[0];
-    send_frame.frame.packet.data.size = MELO_CFG_MAX_DATA_LENGTH;
+    MeloContext * ctx = NULL;
+    uint16_t      slot;
 
-    recv_frame.buffer.data = &recv_frame_buffer[0];
-    recv_frame.buffer.size = MELO_MAX_FRAME_SIZE;
-    recv_frame.frame.packet.data.data = &recv_packet_buffer[0];
-    recv_frame.frame.packet.data.size = MELO_CFG_MAX_DATA_LENGTH;
-
-    _init_event_stack();
-}
-
-void MeloBackground(void)
-{
-    uint8_t event;
+    /* The first slot not in use, slots given back by MeloFreeCtx are used again */
+    for (slot = 0; (slot < MELO_CFG_MAX_CONTEXTS) && (ctx == NULL); slot++)
+    {
+        if (_m_contexts_used[slot] == false)
+        {
+            _m_contexts_used[slot] = true;
+            ctx = &(_m_contexts[slot]);
+        }
+        else
+        {
+            /* Do nothing - slot in use */
+        }
+    }
 
-    for (event = _get_event(); event != MELO_EVENT_IDLE; event = _get_event())
+    if (ctx != NULL)
     {
-        _current_state = _table[_current_state].function(_STATE_ACTION_DURING, event);
+        _melo_init_ctx(ctx, callbacks, user_data);
+    }
+    else
+    {
+        /* Error - no free context, increase MELO_CFG_MAX_CONTEXTS */
     }
-}
 
-/******************************************************************************
-*                          Local Function Definitions                         *
-******************************************************************************/
-static bool _service_NULL(const _m_packet * const request, _m_packet * const response)
-{
-    return false;
+    return ctx;
 }
 
-static void _notify_event(const uint8_t event)
+void MeloFreeCtx(MeloContext * const ctx)
 {
-    if (_m_event_stack.length == (_m_event_stack.size - 1))
-    {
-        /* Do nothing - the stack is full */
-    }
-    else
+    uint16_t slot;
+
+    for (slot = 0; slot < MELO_CFG_MAX_CONTEXTS; slot++)
     {
-        if (_m_event_stack.data[_m_event_stack.length] == event)
+        if (ctx == &(_m_contexts[slot]))
         {
-            /* Do nothing - ignore duplicate events */
+            /* Nothing is called back any more, the slot is free for MeloInitCtx */
+            ctx->callbacks = NULL;
+            ctx->user_data = NULL;
+            _m_contexts_used[slot] = false;
         }
         else
         {
-            _m_event_stack.length++;
-            _m_event_stack.data[_m_event_stack.length] = event;
+            /* Do nothing - another slot */
         }
     }
 }
 
-static uint32_t _melo_esafe_uint32(const uint8_t * const bytes, const uint8_t pe, const uint8_t he)
+uint16_t MeloBackgroundCtx(MeloContext * const ctx)
 {
-    uint32_t result = 0;
+    uint16_t elapsed;
+
+    MELO_CFG_ENTER_CRITICAL();
+    elapsed    = ctx->ticks;
+    ctx->ticks = 0;
+    MELO_CFG_EXIT_CRITICAL();
 
-    if ( pe == he )
+    _state_tick(ctx, elapsed);
+    _melo_segment_tick(ctx, elapsed);
+    _melo_wait_tick(ctx, elapsed);
+    _melo_operation_step(ctx);
+    _melo_dispatch_events(ctx);
+
+    /* A deadline has passed, let the AFTER() guards run */
+    if (_state_deadline(ctx) == 0)
     {
-        result |= ( ((uint32_t) bytes[0])                    );
-        result |= ( ((uint32_t) bytes[1]) << ((uint8_t) 8u ) );
-        result |= ( ((uint32_t) bytes[2]) << ((uint8_t) 16u) );
-        result |= ( ((uint32_t) bytes[3]) << ((uint8_t) 24u) );
+        ctx->sm.current = _state_dispatch(ctx, MELO_EVENT_TIMEOUT);
+        _melo_dispatch_events(ctx);
     }
     else
     {
-        result |= ( ((uint32_t) bytes[3])                    );
-        result |= ( ((uint32_t) bytes[2]) << ((uint8_t) 8u ) );
-        result |= ( ((uint32_t) bytes[1]) << ((uint8_t) 16u) );
-        result |= ( ((uint32_t) bytes[0]) << ((uint8_t) 24u) );
+        /* Do nothing - no timeout */
     }
 
-    return result;
+    return _melo_operation_deadline(ctx, _melo_segment_deadline(ctx, _state_deadline(ctx)));
 }
 
-static uint16_t _melo_esafe_uint16(const uint8_t * const bytes, const uint8_t pe, const uint8_t he)
+void MeloTickCtx(MeloContext * const ctx, const uint16_t elapsed_ms)
 {
-    uint16_t result = 0;
+    uint16_t headroom;
+
+    MELO_CFG_ENTER_CRITICAL();
 
-    if ( pe == he )
+    /* Saturate, MeloBackground only needs to know that every deadline has passed */
+    headroom = (uint16_t) (UINT16_MAX - ctx->ticks);
+
+    if (elapsed_ms > headroom)
     {
-        result |= ( ((uint16_t) bytes[0])                    );
-        result |= ( ((uint16_t) bytes[1]) << ((uint8_t) 8u ) );
+        ctx->ticks = UINT16_MAX;
     }
     else
     {
-        result |= ( ((uint16_t) bytes[1])                    );
-        result |= ( ((uint16_t) bytes[0]) << ((uint8_t) 8u ) );
+        ctx->ticks += elapsed_ms;
     }
 
-    return result;
+    MELO_CFG_EXIT_CRITICAL();
 }
 
-static bool _service_read_write(const _m_packet * const request, _m_packet * const response)
+#ifdef MELO_CFG_DAQ
+void MeloDaqTriggerCtx(MeloContext * const ctx, const uint8_t event_channel)
 {
-    bool            result = true;
-    uint8_t       * address_ptr;
-    uint32_t        address;
-    uint8_t         index;
-    _melo_data_ptr  data_ptr;
-
-    address       = _melo_esafe_uint32( &(request->data.data[0]), MELO_CFG_PE_ENDIANESS, request->byte_order );
-    address_ptr   = MeloCreatePointer( address );
-    data_ptr.size = request->command.fields.subfunction & MELO_RW_SIZE_REQ_MASK;
+    _m_daq_list * list;
+    uint8_t       index;
+    uint8_t       entry;
+    bool          sampled = false;
 
-    if (data_ptr.size == 0)
-    {
-        /* 0 : uint8_t -> 1 byte */
-        data_ptr.size  = 1;
-    }
-    else
+    for (index = 0; index < MELO_CFG_DAQ_LISTS; index++)
     {
-        /*
-            1 : uint16_t -> 2 bytes
-            2 : uint32_t -> 4 bytes
-        */
-        data_ptr.size <<= 1;
-    }
+        list = &(ctx->daq_lists[index]);
 
-    if ( (request->command.fields.subfunction & MELO_WRITE_BY_ADDR_MASK) == MELO_WRITE_BY_ADDR_MASK)
-    {
-        /* Write */
-        if (data_ptr.size <= MELO_RW_SIZE_OF_DWORD)
+        if ( (list->running != false) && (list->channel == event_channel) )
         {
-            /* Write a uint8_t, uint16_t or uint32_t */
-            if (data_ptr.size == MELO_RW_SIZE_OF_BYTE)
-            {
-                data_ptr.byte_val = request->data.data[MELO_SIZE_OF_MEM_ADDR];
-                *address_ptr      = data_ptr.byte_val;
-            }
-            else if (data_ptr.size == MELO_RW_SIZE_OF_WORD)
+            list->divider++;
+
+            if (list->divider >= list->prescaler)
             {
-                data_ptr.word_val    = _melo_esafe_uint16( &(request->data.data[MELO_SIZE_OF_MEM_ADDR]), MELO_CFG_PE_ENDIANESS, request->byte_order );
-                data_ptr.word_ptr    = (uint16_t *) address_ptr;
-                *(data_ptr.word_ptr) = data_ptr.word_val;
+                list->divider = 0;
+
+                /* A list still waiting for transmission keeps its sample, the gap shows in the counter */
+                if (IS_BIT_SET(ctx->daq_pending, index) == false)
+                {
+                    list->sample[0] = index;
+                    list->sample[1] = ctx->daq_counter[index];
+                    list->sample_length = MELO_DAQ_SAMPLE_HEADER_SIZE;
+
+                    for (entry = 0; entry < list->count; entry++)
+                    {
+                        _melo_copy_value(&(list->sample[list->sample_length]), list->entries[entry].address, list->entries[entry].size);
+                        list->sample_length += list->entries[entry].size;
+                    }
+
+                    MELO_CFG_ENTER_CRITICAL();
+                    BIT_SET(ctx->daq_pending, index);
+                    MELO_CFG_EXIT_CRITICAL();
+
+                    sampled = true;
+                }
+                else
+                {
+                    /* Error - overrun */
+                }
+
+                ctx->daq_counter[index]++;
             }
             else
             {
-                data_ptr.dword_val    = _melo_esafe_uint32( &(request->data.data[MELO_SIZE_OF_MEM_ADDR]), MELO_CFG_PE_ENDIANESS, request->byte_order );
-                data_ptr.dword_ptr    = (uint32_t *) address_ptr;
-                *(data_ptr.dword_ptr) = data_ptr.dword_val;
+                /* Do nothing - prescaler not reached */
             }
-
-            response->data.length  = 1;
-            response->data.data[0] = 0x45;
         }
         else
         {
-            /* 3: unit8_t * n - n byte(s)  */
-            result = false;
+            /* Do nothing - list not bound to this event */
         }
     }
+
+    if (sampled != false)
+    {
+        _notify_event(ctx, MELO_EVENT_DAQ_TRIGGER);
+    }
     else
     {
-        /* Read */
-        if (data_ptr.size <= MELO_RW_SIZE_OF_DWORD)
-        {
-            /* Read a uint8_t, uint16_t or uint32_t */
-            response->data.length = data_ptr.size;
-
-            for (index = 0; index < response->data.length; index++)
-            {
-                response->data.data[index] = address_ptr[index];
-            }
-        }
-        else
-        {
-            /* 3: unit8_t * n - n byte(s) */
-            result = false;
-        }
+        /* Do nothing - nothing to send */
     }
+}
+#endif
 
-    return result;
+#ifdef MELO_CFG_FLASH
+void MeloFlashCompleteCtx(MeloContext * const ctx, const bool success)
+{
+    _melo_operation_complete(ctx, success);
 }
+#endif
 
-static void _melo_create_r(uint8_t * const b)
+#ifdef MELO_CFG_DEFAULT_CONTEXT
+void MeloInit(void)
 {
-	*b = ((*b & RESERVED_TX_HIGH_MASK) << 1u) | (*b & RESERVED_LOW_MASK);
+    _melo_init_ctx(&_m_default_context, &_m_default_callbacks, NULL);
 }
 
-static void _melo_restore_r(uint8_t * const b)
+uint16_t MeloBackground(void)
 {
-	*b = ((*b & RESERVED_RX_HIGH_MASK) >> 1u) | (*b & RESERVED_LOW_MASK);
+    return MeloBackgroundCtx(&_m_default_context);
 }
 
-static uint8_t _get_event(void)
+void MeloTick(const uint16_t elapsed_ms)
 {
-    uint8_t element;
+    MeloTickCtx(&_m_default_context, elapsed_ms);
+}
 
-    if (_m_event_stack.length == 0)
-    {
-        element = MELO_EVENT_IDLE;
-    }
-    else
+void MeloTransmitComplete(void)
+{
+    MeloTransmitCompleteCtx(&_m_default_context);
+}
+
+void MeloReceiveBytes(const uint8_t * const bytes, const uint8_t num)
+{
+    MeloReceiveBytesCtx(&_m_default_context, bytes, num);
+}
+
+void MeloReceiveByte( const uint8_t byte )
+{
+    MeloReceiveByteCtx(&_m_default_context, byte);
+}
+
+#ifdef MELO_CFG_DAQ
+void MeloDaqTrigger( const uint8_t event_channel )
+{
+    MeloDaqTriggerCtx(&_m_default_context, event_channel);
+}
+#endif
+
+#ifdef MELO_CFG_FLASH
+void MeloFlashComplete( const bool success )
+{
+    MeloFlashCompleteCtx(&_m_default_context, success);
+}
+#endif
+#endif
+
+/******************************************************************************
+*                          Local Function Definitions                         *
+******************************************************************************/
+static void _melo_init_ctx(MeloContext * const ctx, const MeloCallbacks * const callbacks, void * const user_data)
+{
+    uint8_t index;
+
+    (void) memset(ctx, 0, sizeof(MeloContext));
+
+    ctx->callbacks = callbacks;
+    ctx->user_data = user_data;
+
+    ctx->wait_frame.buffer.data = &(ctx->wait_frame_buffer[0]);
+    ctx->wait_frame.buffer.size = MELO_MAX_WAIT_FRAME_SIZE;
+    ctx->wait_frame.frame.packet.data.data = &(ctx->wait_packet_buffer);
+    ctx->wait_frame.frame.packet.data.size = MELO_WAIT_DATA_SIZE;
+
+    ctx->send_frame.buffer.data = &(ctx->send_frame_buffer[0]);
+    ctx->send_frame.buffer.size = MELO_MAX_FRAME_SIZE;
+    ctx->send_frame.frame.packet.data.data = &(ctx->send_packet_buffer[0]);
+    ctx->send_frame.frame.packet.data.size = MELO_CFG_MAX_DATA_LENGTH;
+
+    for (index = 0; index < MELO_CFG_RX_FRAME_COUNT; index++)
+    {
+        ctx->recv_frames[index].buffer.data = &(ctx->recv_frame_buffer[index][0]);
+        ctx->recv_frames[index].buffer.size = MELO_MAX_FRAME_SIZE;
+        ctx->recv_frames[index].frame.packet.data.size = MELO_CFG_MAX_DATA_LENGTH;
+    }
+
+#ifdef MELO_CFG_DAQ
+    /* DAQ frames are only sent from IDLE, so they share the response buffer */
+    ctx->daq_frame.buffer.data = &(ctx->send_frame_buffer[0]);
+    ctx->daq_frame.buffer.size = MELO_MAX_FRAME_SIZE;
+    ctx->daq_frame.frame.packet.data.size = MELO_CFG_MAX_DATA_LENGTH;
+#endif
+
+#ifdef MELO_CFG_SEGMENT
+    /* Consecutive frames of a read are only sent from IDLE as well */
+    ctx->segment_frame.buffer.data = &(ctx->send_frame_buffer[0]);
+    ctx->segment_frame.buffer.size = MELO_MAX_FRAME_SIZE;
+    ctx->segment_frame.frame.packet.data.data = &(ctx->send_packet_buffer[0]);
+    ctx->segment_frame.frame.packet.data.size = MELO_CFG_MAX_DATA_LENGTH;
+#endif
+}
+
+#ifdef MELO_CFG_DEFAULT_CONTEXT
+static uint8_t * _default_create_pointer(MeloContext * const ctx, const uint32_t address)
+{
+    (void) ctx;
+    return MeloCreatePointer(address);
+}
+
+static void _default_transmit_bytes(MeloContext * const ctx, const uint8_t * const bytes, const uint8_t length)
+{
+    (void) ctx;
+    MeloTransmitBytes(bytes, length);
+}
+
+#ifdef MELO_CFG_MODE_MASTER
+static void _default_request_bytes(MeloContext * const ctx, const uint8_t num)
+{
+    (void) ctx;
+    MeloRequestBytes(num);
+}
+
+static void _default_receive_response(MeloContext * const ctx, const uint8_t tag, const uint8_t service, const uint8_t subfunction, const uint8_t * const bytes, const uint8_t length, bool postive, const uint8_t byte_order)
+{
+    (void) ctx;
+    (void) tag;
+    (void) byte_order;
+    MeloReceiveResponse(service, subfunction, bytes, length, postive);
+}
+#endif
+
+#ifdef MELO_CFG_FLASH
+static bool _default_flash_erase(MeloContext * const ctx, const uint32_t address, const uint32_t length)
+{
+    (void) ctx;
+    return MeloFlashErase(address, length);
+}
+
+static bool _default_flash_write(MeloContext * const ctx, const uint32_t address, const uint8_t * const bytes, const uint8_t length)
+{
+    (void) ctx;
+    return MeloFlashWrite(address, bytes, length);
+}
+#endif
+#endif
+
+static void _notify_event(MeloContext * const ctx, const uint8_t event)
+{
+    uint8_t head;
+
+    MELO_CFG_ENTER_CRITICAL();
+
+    head = ctx->events.head;
+
+    if ( ((uint8_t) (head - ctx->events.tail)) >= MELO_CFG_EVENT_QUEUE_SIZE )
+    {
+        /* Error - the queue is full */
+        if (ctx->events.overflow < UINT8_MAX)
+        {
+            ctx->events.overflow++;
+        }
+        else
+        {
+            /* Do nothing - saturated */
+        }
+    }
+    else
+    {
+        /* Store the event before publishing it to the consumer */
+        ctx->events.data[head & MELO_EVENT_QUEUE_MASK] = event;
+        ctx->events.head = (uint8_t) (head + 1u);
+    }
+
+    MELO_CFG_EXIT_CRITICAL();
+}
+
+static MELO_INLINE uint32_t _melo_esafe_uint32(const uint8_t * const bytes, const uint8_t pe, const uint8_t he)
+{
+    uint32_t result;
+
+    /* A straight (unaligned safe) load when the frame matches the processor, a byte swap otherwise */
+    (void) memcpy(&result, bytes, sizeof(result));
+
+    if ( pe != he )
+    {
+        result = MELO_BSWAP32(result);
+    }
+    else
+    {
+        /* Do nothing - same byte order */
+    }
+
+    return result;
+}
+
+static MELO_INLINE uint16_t _melo_esafe_uint16(const uint8_t * const bytes, const uint8_t pe, const uint8_t he)
+{
+    uint16_t result;
+
+    (void) memcpy(&result, bytes, sizeof(result));
+
+    if ( pe != he )
+    {
+        result = MELO_BSWAP16(result);
+    }
+    else
+    {
+        /* Do nothing - same byte order */
+    }
+
+    return result;
+}
+
+static void _melo_esafe_copy(uint8_t * const dest, const uint8_t * const src, const uint8_t length, const uint8_t width, const uint8_t pe, const uint8_t he)
+{
+    uint8_t        index;
+    _melo_data_ptr data_ptr;
+
+    if ( (pe == he) || (width == MELO_RW_SIZE_OF_BYTE) )
+    {
+        (void) memcpy(dest, src, length);
+    }
+    else if (width == MELO_RW_SIZE_OF_WORD)
+    {
+        for (index = 0; index < length; index += MELO_RW_SIZE_OF_WORD)
+        {
+            data_ptr.word_val = _melo_esafe_uint16( &(src[index]), pe, he );
+            (void) memcpy(&(dest[index]), &(data_ptr.word_val), MELO_RW_SIZE_OF_WORD);
+        }
+    }
+    else
+    {
+        for (index = 0; index < length; index += MELO_RW_SIZE_OF_DWORD)
+        {
+            data_ptr.dword_val = _melo_esafe_uint32( &(src[index]), pe, he );
+            (void) memcpy(&(dest[index]), &(data_ptr.dword_val), MELO_RW_SIZE_OF_DWORD);
+        }
+    }
+}
+
+static bool _service_read_write(MeloContext * const ctx, const MeloMessage * const request, MeloMessage * const response)
+{
+    bool            result = true;
+    uint8_t       * address_ptr;
+    uint32_t        address;
+    uint8_t         index;
+    _melo_data_ptr  data_ptr;
+
+    address       = _melo_esafe_uint32( &(request->data.data[0]), MELO_CFG_PE_ENDIANESS, request->byte_order );
+    address_ptr   = ctx->callbacks->create_pointer( ctx, address );
+    data_ptr.size = request->subfunction & MELO_RW_SIZE_REQ_MASK;
+
+    if (data_ptr.size == MELO_RW_SIZE_REQ_BLOCK)
+    {
+        /* 3: unit8_t * n - n byte(s) */
+        result = _service_read_write_block(request, response, address_ptr);
+    }
+    else
+    {
+        if (data_ptr.size == 0)
+        {
+            /* 0 : uint8_t -> 1 byte */
+            data_ptr.size  = 1;
+        }
+        else
+        {
+            /*
+                1 : uint16_t -> 2 bytes
+                2 : uint32_t -> 4 bytes
+            */
+            data_ptr.size <<= 1;
+        }
+
+        if ( (request->subfunction & MELO_WRITE_BY_ADDR_MASK) == MELO_WRITE_BY_ADDR_MASK)
+        {
+            /* Write a uint8_t, uint16_t or uint32_t */
+            if (data_ptr.size == MELO_RW_SIZE_OF_BYTE)
+            {
+                data_ptr.byte_val = request->data.data[MELO_SIZE_OF_MEM_ADDR];
+                *address_ptr      = data_ptr.byte_val;
+            }
+            else if (data_ptr.size == MELO_RW_SIZE_OF_WORD)
+            {
+                data_ptr.word_val    = _melo_esafe_uint16( &(request->data.data[MELO_SIZE_OF_MEM_ADDR]), MELO_CFG_PE_ENDIANESS, request->byte_order );
+                data_ptr.word_ptr    = (uint16_t *) address_ptr;
+                *(data_ptr.word_ptr) = data_ptr.word_val;
+            }
+            else
+            {
+                data_ptr.dword_val    = _melo_esafe_uint32( &(request->data.data[MELO_SIZE_OF_MEM_ADDR]), MELO_CFG_PE_ENDIANESS, request->byte_order );
+                data_ptr.dword_ptr    = (uint32_t *) address_ptr;
+                *(data_ptr.dword_ptr) = data_ptr.dword_val;
+            }
+
+            response->data.length  = 1;
+            response->data.data[0] = 0x45;
+        }
+        else
+        {
+            /* Read a uint8_t, uint16_t or uint32_t */
+            response->data.length = data_ptr.size;
+
+            for (index = 0; index < response->data.length; index++)
+            {
+                response->data.data[index] = address_ptr[index];
+            }
+        }
+    }
+
+    return result;
+}
+
+static bool _service_read_write_block(const MeloMessage * const request, MeloMessage * const response, uint8_t * const address_ptr)
+{
+    /*
+        Request:  address (4) | n (1) | [width (1)] | data (n, write only)
+        Response: data (n, read only)
+
+        With a width of 2 or 4 the block is an array of words or dwords in the
+        request's byte order, converted while it is copied.
+    */
+    bool    result = false;
+    uint8_t length;
+    uint8_t header = MELO_RW_BLOCK_HEADER_SIZE;
+    uint8_t width  = MELO_RW_SIZE_OF_BYTE;
+    bool    write  = ( (request->subfunction & MELO_WRITE_BY_ADDR_MASK) == MELO_WRITE_BY_ADDR_MASK ) ? true : false;
+
+    if (request->data.length >= MELO_RW_BLOCK_HEADER_SIZE)
+    {
+        length = request->data.data[MELO_SIZE_OF_MEM_ADDR];
+
+        /* The optional width byte makes the request one byte longer than the plain form */
+        if (request->data.length == (MELO_RW_BLOCK_HEADER_SIZE + MELO_RW_BLOCK_WIDTH_SIZE + ((write != false) ? length : 0u)))
+        {
+            width   = request->data.data[MELO_RW_BLOCK_HEADER_SIZE];
+            header += MELO_RW_BLOCK_WIDTH_SIZE;
+        }
+        else
+        {
+            /* Do nothing - plain byte block */
+        }
+
+        if (length > MELO_CFG_MAX_DATA_LENGTH)
+        {
+            /* Error - the block does not fit in a single frame */
+        }
+        else if ( ((width != MELO_RW_SIZE_OF_BYTE) && (width != MELO_RW_SIZE_OF_WORD) && (width != MELO_RW_SIZE_OF_DWORD)) ||
+                  ((length % width) != 0) )
+        {
+            /* Error - invalid element width */
+        }
+        else if (write != false)
+        {
+            /* Write */
+            if (request->data.length == (header + length))
+            {
+                _melo_esafe_copy(address_ptr, &(request->data.data[header]), length, width, MELO_CFG_PE_ENDIANESS, request->byte_order);
+
+                response->data.length  = 1;
+                response->data.data[0] = 0x45;
+                result = true;
+            }
+            else
+            {
+                /* Error - the block length does not match the data received */
+            }
+        }
+        else if (request->data.length == header)
+        {
+            /* Read, an array is returned in the request's byte order */
+            _melo_esafe_copy(&(response->data.data[0]), address_ptr, length, width, MELO_CFG_PE_ENDIANESS, request->byte_order);
+
+            if (width != MELO_RW_SIZE_OF_BYTE)
+            {
+                response->byte_order = request->byte_order;
+            }
+            else
+            {
+                /* Do nothing - bytes have no order */
+            }
+
+            response->data.length = length;
+            result = true;
+        }
+        else
+        {
+            /* Error - the request length is invalid */
+        }
+    }
+    else
+    {
+        /* Error - request is too short */
+    }
+
+    return result;
+}
+
+static bool _service_gather_read(MeloContext * const ctx, const MeloMessage * const request, MeloMessage * const response)
+{
+    /*
+        Request:  { address (4) | size (1) } * n, size is 1, 2 or 4
+        Response: value (size) * n, packed in the slave's byte order
+    */
+    bool            result = true;
+    uint8_t         offset;
+    uint32_t        address;
+    _melo_data_ptr  data_ptr;
+
+    response->data.length = 0;
+
+    if ( (request->data.length == 0) || ((request->data.length % MELO_GATHER_ENTRY_SIZE) != 0) )
+    {
+        /* Error - request is not a list of entries */
+        result = false;
+    }
+    else
+    {
+        /* Do nothing - valid request */
+    }
+
+    for (offset = 0; (offset < request->data.length) && (result != false); offset += MELO_GATHER_ENTRY_SIZE)
+    {
+        address       = _melo_esafe_uint32( &(request->data.data[offset]), MELO_CFG_PE_ENDIANESS, request->byte_order );
+        data_ptr.size = request->data.data[offset + MELO_SIZE_OF_MEM_ADDR];
+
+        if ( (response->data.length + data_ptr.size) > MELO_CFG_MAX_DATA_LENGTH )
+        {
+            /* Error - the values do not fit in a single frame */
+            result = false;
+        }
+        else if ( (data_ptr.size == MELO_RW_SIZE_OF_BYTE) || (data_ptr.size == MELO_RW_SIZE_OF_WORD) || (data_ptr.size == MELO_RW_SIZE_OF_DWORD) )
+        {
+            data_ptr.byte_ptr = ctx->callbacks->create_pointer( ctx, address );
+            _melo_copy_value(&(response->data.data[response->data.length]), data_ptr.byte_ptr, data_ptr.size);
+        }
+        else
+        {
+            /* Error - invalid element size */
+            result = false;
+        }
+
+        if (result != false)
+        {
+            response->data.length += data_ptr.size;
+        }
+        else
+        {
+            response->data.length = 0;
+        }
+    }
+
+    return result;
+}
+
+static void _melo_copy_value(uint8_t * const dest, const uint8_t * const src, const uint8_t size)
+{
+    _melo_data_ptr data_ptr;
+
+    /* Read the variable in one access, then store it in native order */
+    if (size == MELO_RW_SIZE_OF_WORD)
+    {
+        data_ptr.word_val = *((const uint16_t *) src);
+        (void) memcpy(dest, &(data_ptr.word_val), MELO_RW_SIZE_OF_WORD);
+    }
+    else if (size == MELO_RW_SIZE_OF_DWORD)
+    {
+        data_ptr.dword_val = *((const uint32_t *) src);
+        (void) memcpy(dest, &(data_ptr.dword_val), MELO_RW_SIZE_OF_DWORD);
+    }
+    else
+    {
+        *dest = *src;
+    }
+}
+
+#ifdef MELO_CFG_DAQ
+static bool _service_daq(MeloContext * const ctx, const MeloMessage * const request, MeloMessage * const response)
+{
+    bool    result = false;
+    uint8_t index;
+
+    if (request->subfunction == MELO_DAQ_CLEAR)
+    {
+        MELO_CFG_ENTER_CRITICAL();
+        for (index = 0; index < MELO_CFG_DAQ_LISTS; index++)
+        {
+            ctx->daq_lists[index].running = false;
+            ctx->daq_lists[index].count   = 0;
+        }
+        ctx->daq_pending = 0;
+        MELO_CFG_EXIT_CRITICAL();
+
+        result = true;
+    }
+    else if (request->subfunction == MELO_DAQ_SET_LIST)
+    {
+        result = _service_daq_set_list(ctx, request);
+    }
+    else if ( (request->data.length == 1) && (request->data.data[0] < MELO_CFG_DAQ_LISTS) )
+    {
+        index = request->data.data[0];
+
+        if (request->subfunction == MELO_DAQ_START)
+        {
+            ctx->daq_lists[index].divider = 0;
+            ctx->daq_lists[index].running = true;
+            result = true;
+        }
+        else if (request->subfunction == MELO_DAQ_STOP)
+        {
+            ctx->daq_lists[index].running = false;
+            result = true;
+        }
+        else
+        {
+            /* Error - invalid subfunction */
+        }
+    }
+    else
+    {
+        /* Error - invalid list */
+    }
+
+    if (result != false)
+    {
+        response->data.length  = 1;
+        response->data.data[0] = 0x45;
+    }
+    else
+    {
+        response->data.length = 0;
+    }
+
+    return result;
+}
+
+static bool _service_daq_set_list(MeloContext * const ctx, const MeloMessage * const request)
+{
+    /*
+        Request: list (1) | event channel (1) | prescaler (1) | { address (4) | size (1) } * n
+    */
+    bool          result = false;
+    _m_daq_list * list;
+    uint8_t       offset;
+    uint8_t       size;
+    uint8_t       length = MELO_DAQ_SAMPLE_HEADER_SIZE;
+
+    if ( (request->data.length >= MELO_DAQ_LIST_HEADER_SIZE) &&
+         (request->data.data[0] < MELO_CFG_DAQ_LISTS) &&
+         (((request->data.length - MELO_DAQ_LIST_HEADER_SIZE) % MELO_GATHER_ENTRY_SIZE) == 0) &&
+         (((request->data.length - MELO_DAQ_LIST_HEADER_SIZE) / MELO_GATHER_ENTRY_SIZE) <= MELO_CFG_DAQ_MAX_ENTRIES) )
+    {
+        list = &(ctx->daq_lists[request->data.data[0]]);
+
+        if (list->running == false)
+        {
+            result = true;
+
+            /* Validate every entry before changing the list */
+            for (offset = MELO_DAQ_LIST_HEADER_SIZE; (offset < request->data.length) && (result != false); offset += MELO_GATHER_ENTRY_SIZE)
+            {
+                size    = request->data.data[offset + MELO_SIZE_OF_MEM_ADDR];
+                length += size;
+
+                if ( ((size != MELO_RW_SIZE_OF_BYTE) && (size != MELO_RW_SIZE_OF_WORD) && (size != MELO_RW_SIZE_OF_DWORD)) ||
+                     (length > MELO_CFG_MAX_DATA_LENGTH) )
+                {
+                    /* Error - invalid element size or the sample does not fit in a single frame */
+                    result = false;
+                }
+                else
+                {
+                    /* Do nothing - valid entry */
+                }
+            }
+        }
+        else
+        {
+            /* Error - a running list must be stopped first */
+        }
+
+        if (result != false)
+        {
+            list->channel   = request->data.data[1];
+            list->prescaler = (request->data.data[2] != 0) ? request->data.data[2] : 1u;
+            list->count     = 0;
+
+            for (offset = MELO_DAQ_LIST_HEADER_SIZE; offset < request->data.length; offset += MELO_GATHER_ENTRY_SIZE)
+            {
+                /* Resolve the addresses once, the trigger only copies */
+                list->entries[list->count].address = ctx->callbacks->create_pointer( ctx, _melo_esafe_uint32( &(request->data.data[offset]), MELO_CFG_PE_ENDIANESS, request->byte_order ) );
+                list->entries[list->count].size    = request->data.data[offset + MELO_SIZE_OF_MEM_ADDR];
+                list->count++;
+            }
+        }
+        else
+        {
+            /* Do nothing - list unchanged */
+        }
+    }
+    else
+    {
+        /* Error - malformed list */
+    }
+
+    return result;
+}
+#endif
+
+#ifdef MELO_CFG_SEGMENT
+static bool _service_transfer(MeloContext * const ctx, const MeloMessage * const request, MeloMessage * const response)
+{
+    /*
+        Write: WRITE first frame, then CONSECUTIVE frames from the master. Every
+               MELO_CFG_SEGMENT_BLOCK_SIZE frames are answered with a FLOW_CONTROL frame,
+               the last one with a positive response; the others are not answered.
+        Read:  READ first frame, answered with the length and the first data. Each
+               FLOW_CONTROL frame from the master releases a block of CONSECUTIVE frames.
+
+        The data is copied between the receive or transmit buffer and memory, so a transfer
+        of any length only needs the buffers of a single frame.
+    */
+    bool result = false;
+
+    response->data.length = 0;
+
+    if ( (request->subfunction == MELO_TRANSFER_WRITE) || (request->subfunction == MELO_TRANSFER_READ) )
+    {
+        result = _service_transfer_first(ctx, request, response);
+    }
+    else if (request->subfunction == MELO_TRANSFER_CONSECUTIVE)
+    {
+        result = _service_transfer_consecutive(ctx, request, response);
+    }
+    else if (request->subfunction == MELO_TRANSFER_FLOW_CONTROL)
+    {
+        result = _service_transfer_flow_control(ctx, request, response);
+    }
+    else
+    {
+        /* Error - invalid subfunction */
+    }
+
+    if (result == false)
+    {
+        /* Any error aborts the transfer */
+        ctx->segment.mode = MELO_SEGMENT_IDLE;
+    }
+    else
+    {
+        /* Do nothing - transfer continues */
+    }
+
+    return result;
+}
+
+static bool _service_transfer_first(MeloContext * const ctx, const MeloMessage * const request, MeloMessage * const response)
+{
+    /*
+        Request:  address (4) | length (2) | data (write only)
+        Response: write - FLOW_CONTROL, or 0x45 when the data fit in the first frame
+                  read  - length (2) | data
+    */
+    _m_segment * const segment = &(ctx->segment);
+    bool               result  = false;
+    uint16_t           length;
+    uint8_t            chunk;
+
+    if (request->data.length >= MELO_SEGMENT_FIRST_HEADER_SIZE)
+    {
+        length = _melo_esafe_uint16( &(request->data.data[MELO_SIZE_OF_MEM_ADDR]), MELO_CFG_PE_ENDIANESS, request->byte_order );
+        chunk  = request->data.length - MELO_SEGMENT_FIRST_HEADER_SIZE;
+
+        /* A first frame replaces any transfer in progress, the following frames use its framing */
+        segment->address     = ctx->callbacks->create_pointer( ctx, _melo_esafe_uint32( &(request->data.data[0]), MELO_CFG_PE_ENDIANESS, request->byte_order ) );
+        segment->remaining   = length;
+        segment->sequence    = 1u;
+        segment->block       = 0;
+        segment->gap         = 0;
+        segment->cobs        = ctx->send_frame.frame.packet.cobs;
+        segment->crc_present = ctx->send_frame.crc_present;
+
+        if (request->subfunction == MELO_TRANSFER_WRITE)
+        {
+            if (chunk <= length)
+            {
+                (void) memcpy(segment->address, &(request->data.data[MELO_SEGMENT_FIRST_HEADER_SIZE]), chunk);
+                segment->address   += chunk;
+                segment->remaining -= chunk;
+
+                if (segment->remaining > 0)
+                {
+                    segment->mode  = MELO_SEGMENT_WRITE;
+                    segment->block = MELO_CFG_SEGMENT_BLOCK_SIZE;
+                    _service_transfer_flow(response);
+                }
+                else
+                {
+                    segment->mode          = MELO_SEGMENT_IDLE;
+                    response->data.length  = 1;
+                    response->data.data[0] = 0x45;
+                }
+
+                result = true;
+            }
+            else
+            {
+                /* Error - more data than announced */
+            }
+        }
+        else if (chunk == 0)
+        {
+            chunk = (segment->remaining < (MELO_CFG_MAX_DATA_LENGTH - MELO_SEGMENT_LENGTH_SIZE)) ? (uint8_t) segment->remaining : (uint8_t) (MELO_CFG_MAX_DATA_LENGTH - MELO_SEGMENT_LENGTH_SIZE);
+
+            /* The length is returned in the slave's byte order, like the frame */
+            (void) memcpy(&(response->data.data[0]), &length, MELO_SEGMENT_LENGTH_SIZE);
+            (void) memcpy(&(response->data.data[MELO_SEGMENT_LENGTH_SIZE]), segment->address, chunk);
+            response->data.length = MELO_SEGMENT_LENGTH_SIZE + chunk;
+
+            segment->address   += chunk;
+            segment->remaining -= chunk;
+
+            /* The consecutive frames wait for the master's flow control */
+            segment->mode = (segment->remaining > 0) ? MELO_SEGMENT_READ_WAIT : MELO_SEGMENT_IDLE;
+            result        = true;
+        }
+        else
+        {
+            /* Error - a read carries no data */
+        }
+    }
+    else
+    {
+        /* Error - request is too short */
+    }
+
+    return result;
+}
+
+static bool _service_transfer_consecutive(MeloContext * const ctx, const MeloMessage * const request, MeloMessage * const response)
+{
+    /*
+        Request:  sequence (1) | data
+        Response: none inside a block, FLOW_CONTROL at its end, 0x45 after the last frame
+    */
+    _m_segment * const segment = &(ctx->segment);
+    bool               result  = false;
+    uint8_t            chunk;
+
+    if ( (segment->mode == MELO_SEGMENT_WRITE) &&
+         (request->data.length > MELO_SEGMENT_SEQUENCE_SIZE) &&
+         (request->data.data[0] == segment->sequence) &&
+         ((uint16_t) (request->data.length - MELO_SEGMENT_SEQUENCE_SIZE) <= segment->remaining) )
+    {
+        chunk = request->data.length - MELO_SEGMENT_SEQUENCE_SIZE;
+
+        (void) memcpy(segment->address, &(request->data.data[MELO_SEGMENT_SEQUENCE_SIZE]), chunk);
+        segment->address   += chunk;
+        segment->remaining -= chunk;
+        segment->sequence   = (segment->sequence + 1u) & MELO_SEGMENT_SEQUENCE_MASK;
+
+        if (segment->remaining == 0)
+        {
+            segment->mode          = MELO_SEGMENT_IDLE;
+            response->data.length  = 1;
+            response->data.data[0] = 0x45;
+        }
+        else if (segment->block == 1u)
+        {
+            segment->block = MELO_CFG_SEGMENT_BLOCK_SIZE;
+            _service_transfer_flow(response);
+        }
+        else
+        {
+            if (segment->block > 0)
+            {
+                segment->block--;
+            }
+            else
+            {
+                /* Do nothing - no block limit */
+            }
+
+            ctx->reply = MELO_REPLY_NONE;
+        }
+
+        result = true;
+    }
+    else
+    {
+        /* Error - no write in progress, frame out of sequence or more data than announced */
+    }
+
+    return result;
+}
+
+static bool _service_transfer_flow_control(MeloContext * const ctx, const MeloMessage * const request, MeloMessage * const response)
+{
+    /*
+        Request:  flow status (1) | block size (1) | separation time (1)
+        Response: none when continuing, the consecutive frames follow; 0x45 when aborted
+    */
+    _m_segment * const segment = &(ctx->segment);
+    bool               result  = false;
+
+    if ( ((segment->mode == MELO_SEGMENT_READ_WAIT) || (segment->mode == MELO_SEGMENT_READ)) &&
+         (request->data.length == MELO_SEGMENT_FLOW_SIZE) )
+    {
+        if (request->data.data[0] == MELO_FLOW_CONTINUE)
+        {
+            /* A block size of 0 sends the rest without further flow control */
+            segment->mode   = MELO_SEGMENT_READ;
+            segment->block  = request->data.data[1];
+            segment->st_min = request->data.data[2];
+            ctx->reply      = MELO_REPLY_NONE;
+        }
+        else
+        {
+            /* The master gives up the read */
+            segment->mode          = MELO_SEGMENT_IDLE;
+            response->data.length  = 1;
+            response->data.data[0] = 0x45;
+        }
+
+        result = true;
+    }
+    else
+    {
+        /* Error - no read in progress or malformed flow control */
+    }
+
+    return result;
+}
+
+static void _service_transfer_flow(MeloMessage * const response)
+{
+    response->subfunction  = MELO_TRANSFER_FLOW_CONTROL;
+    response->data.data[0] = MELO_FLOW_CONTINUE;
+    response->data.data[1] = MELO_CFG_SEGMENT_BLOCK_SIZE;
+    response->data.data[2] = MELO_CFG_SEGMENT_ST_MIN;
+    response->data.length  = MELO_SEGMENT_FLOW_SIZE;
+}
+#endif
+
+#ifdef MELO_CFG_FLASH
+static bool _service_flash(MeloContext * const ctx, const MeloMessage * const request, MeloMessage * const response)
+{
+    /*
+        Erase and program are started through the application's callbacks and answered once
+        MeloFlashComplete is called; until then the slave sends pending frames of length 0.
+        Frames received meanwhile wait in the receive buffers, so the next block is received
+        while the current one is programmed.
+    */
+    bool            result = false;
+    uint32_t        address;
+    uint32_t        length;
+    const uint8_t * memory;
+    uint8_t         offset;
+
+    response->data.length = 0;
+
+    if (request->data.length < MELO_SIZE_OF_MEM_ADDR)
+    {
+        /* Error - request is too short */
+    }
+    else if (_melo_operation_pending(ctx) != false)
+    {
+        /* Error - an operation is in progress */
+    }
+    else
+    {
+        address = _melo_esafe_uint32( &(request->data.data[0]), MELO_CFG_PE_ENDIANESS, request->byte_order );
+
+        if ( (request->subfunction == MELO_FLASH_ERASE) && (request->data.length == MELO_FLASH_ERASE_SIZE) )
+        {
+            length = _melo_esafe_uint32( &(request->data.data[MELO_SIZE_OF_MEM_ADDR]), MELO_CFG_PE_ENDIANESS, request->byte_order );
+            _melo_operation_start(ctx, NULL);
+            result = ctx->callbacks->flash_erase(ctx, address, length);
+        }
+        else if ( (request->subfunction == MELO_FLASH_PROGRAM) && (request->data.length > MELO_SIZE_OF_MEM_ADDR) )
+        {
+            /* The block is staged in the response buffer, which is unused until the final response */
+            (void) memcpy(&(response->data.data[0]), &(request->data.data[MELO_SIZE_OF_MEM_ADDR]), request->data.length - MELO_SIZE_OF_MEM_ADDR);
+            _melo_operation_start(ctx, NULL);
+            result = ctx->callbacks->flash_write(ctx, address, &(response->data.data[0]), request->data.length - MELO_SIZE_OF_MEM_ADDR);
+        }
+        else if (request->subfunction == MELO_FLASH_VERIFY)
+        {
+            memory = ctx->callbacks->create_pointer( ctx, address );
+            result = true;
+
+            for (offset = 0; (offset < (request->data.length - MELO_SIZE_OF_MEM_ADDR)) && (result != false); offset++)
+            {
+                if (memory[offset] != request->data.data[MELO_SIZE_OF_MEM_ADDR + offset])
+                {
+                    /* Error - report the first byte that differs */
+                    response->data.data[0] = offset;
+                    response->data.length  = 1;
+                    result = false;
+                }
+                else
+                {
+                    /* Do nothing - byte matches */
+                }
+            }
+        }
+        else
+        {
+            /* Error - invalid subfunction or length */
+        }
+
+        if (result == false)
+        {
+            /* Answered negatively right away */
+            _melo_operation_cancel(ctx);
+        }
+        else if (request->subfunction == MELO_FLASH_VERIFY)
+        {
+            response->data.data[0] = 0x45;
+            response->data.length  = 1;
+        }
+        else
+        {
+            /* Do nothing - answered once the operation completes */
+        }
+    }
+
+    return result;
+}
+#endif
+
+#if defined(MELO_CFG_CHECKSUM) || defined(MELO_CFG_BLOCK_HASH)
+#ifdef MELO_CFG_CHECKSUM
+static bool _service_checksum(MeloContext * const ctx, const MeloMessage * const request, MeloMessage * const response)
+{
+    /*
+        Request:  address (4) | length (4)
+        Response: CRC-32 (4) of the region, computed MELO_CFG_CHECKSUM_CHUNK bytes per
+                  MeloBackground call while the slave sends pending frames
+    */
+    bool     result = false;
+    uint32_t length;
+
+    response->data.length = 0;
+
+    if ( (request->data.length == MELO_CHECKSUM_REQUEST_SIZE) && (_melo_operation_pending(ctx) == false) )
+    {
+        length = _melo_esafe_uint32( &(request->data.data[MELO_SIZE_OF_MEM_ADDR]), MELO_CFG_PE_ENDIANESS, request->byte_order );
+
+        /* The whole region is one block */
+        _melo_checksum_start(ctx, request, length, length);
+        result = true;
+    }
+    else
+    {
+        /* Error - malformed request or an operation is in progress */
+    }
+
+    return result;
+}
+#endif
+
+#ifdef MELO_CFG_BLOCK_HASH
+static bool _service_block_hash(MeloContext * const ctx, const MeloMessage * const request, MeloMessage * const response)
+{
+    /*
+        Request:  address (4) | length (4) | block size (2)
+        Response: CRC-32 (4) of each block from the address, as many as fit in one response,
+                  the last block may be shorter
+    */
+    bool     result = false;
+    uint32_t length;
+    uint16_t block;
+
+    response->data.length = 0;
+
+    if ( (request->data.length == MELO_BLOCK_HASH_REQUEST_SIZE) && (_melo_operation_pending(ctx) == false) )
+    {
+        length = _melo_esafe_uint32( &(request->data.data[MELO_SIZE_OF_MEM_ADDR]), MELO_CFG_PE_ENDIANESS, request->byte_order );
+        block  = _melo_esafe_uint16( &(request->data.data[MELO_SIZE_OF_MEM_ADDR + 4u]), MELO_CFG_PE_ENDIANESS, request->byte_order );
+
+        if ( (length != 0) && (block != 0) )
+        {
+            _melo_checksum_start(ctx, request, length, block);
+            result = true;
+        }
+        else
+        {
+            /* Error - no blocks to hash */
+        }
+    }
+    else
+    {
+        /* Error - malformed request or an operation is in progress */
+    }
+
+    return result;
+}
+#endif
+
+static void _melo_checksum_start(MeloContext * const ctx, const MeloMessage * const request, const uint32_t length, const uint32_t block)
+{
+    _m_checksum * const checksum = &(ctx->checksum);
+
+    checksum->address         = ctx->callbacks->create_pointer( ctx, _melo_esafe_uint32( &(request->data.data[0]), MELO_CFG_PE_ENDIANESS, request->byte_order ) );
+    checksum->remaining       = length;
+    checksum->block           = block;
+    checksum->block_remaining = (length < block) ? length : block;
+    checksum->crc             = MELO_CRC32_INIT;
+    checksum->byte_order      = request->byte_order;
+
+    _melo_operation_start(ctx, _melo_checksum_step);
+}
+
+static void _melo_checksum_step(MeloContext * const ctx)
+{
+    _m_checksum * const checksum = &(ctx->checksum);
+    MeloList    * const hashes   = &(ctx->send_frame.frame.packet.data);
+    uint16_t            chunk    = MELO_CFG_CHECKSUM_CHUNK;
+    uint16_t            index;
+
+    if (checksum->block_remaining < chunk)
+    {
+        chunk = (uint16_t) checksum->block_remaining;
+    }
+    else
+    {
+        /* Do nothing - a full chunk is left */
+    }
+
+    for (index = 0; index < chunk; index++)
+    {
+        checksum->crc = MeloCrc32Table16Update(checksum->crc, checksum->address[index]);
+    }
+
+    checksum->address         += chunk;
+    checksum->remaining       -= chunk;
+    checksum->block_remaining -= chunk;
+
+    if (checksum->block_remaining == 0)
+    {
+        /* Returned in the byte order of the request */
+        checksum->crc ^= MELO_CRC32_XOROUT;
+        _melo_esafe_copy(&(hashes->data[hashes->length]), (const uint8_t *) &(checksum->crc), MELO_CHECKSUM_SIZE, MELO_RW_SIZE_OF_DWORD, MELO_CFG_PE_ENDIANESS, checksum->byte_order);
+        hashes->length += MELO_CHECKSUM_SIZE;
+
+        checksum->crc             = MELO_CRC32_INIT;
+        checksum->block_remaining = (checksum->remaining < checksum->block) ? checksum->remaining : checksum->block;
+
+        if ( (checksum->remaining == 0) || ( (hashes->length + MELO_CHECKSUM_SIZE) > MELO_CFG_MAX_DATA_LENGTH ) )
+        {
+            _melo_operation_complete(ctx, true);
+        }
+        else
+        {
+            /* Do nothing - continued with the next block */
+        }
+    }
+    else
+    {
+        /* Do nothing - continued on the next call */
+    }
+}
+#endif
+
+#ifdef MELO_CFG_MEMORY_OPS
+static bool _service_memory(MeloContext * const ctx, const MeloMessage * const request, MeloMessage * const response)
+{
+    /*
+        Modify is done right away. Fill, copy and search run MELO_CFG_MEMORY_CHUNK bytes per
+        MeloBackground call and are answered once they complete, like a checksum.
+    */
+    bool        result = false;
+    _m_memory * memory = &(ctx->memory);
+    uint32_t    address;
+    uint8_t     pattern_length;
+
+    response->data.length = 0;
+
+    if (request->data.length < MELO_SIZE_OF_MEM_ADDR)
+    {
+        /* Error - request is too short */
+    }
+    else if (_melo_operation_pending(ctx) != false)
+    {
+        /* Error - an operation is in progress */
+    }
+    else if (request->subfunction == MELO_MEMORY_MODIFY)
+    {
+        result = _service_memory_modify(ctx, request, response);
+    }
+    else
+    {
+        address            = _melo_esafe_uint32( &(request->data.data[0]), MELO_CFG_PE_ENDIANESS, request->byte_order );
+        pattern_length     = (request->data.length > MELO_MEMORY_RANGE_SIZE) ? (request->data.length - MELO_MEMORY_RANGE_SIZE) : 0u;
+        memory->address    = address;
+        memory->phase      = 0;
+        memory->byte_order = request->byte_order;
+        memory->backward   = false;
+
+        if ( ( (request->subfunction == MELO_MEMORY_FILL) || (request->subfunction == MELO_MEMORY_SEARCH) ) &&
+             (pattern_length > 0) && (pattern_length <= MELO_CFG_MEMORY_PATTERN) )
+        {
+            memory->destination    = ctx->callbacks->create_pointer( ctx, address );
+            memory->source         = memory->destination;
+            memory->remaining      = _melo_esafe_uint32( &(request->data.data[MELO_SIZE_OF_MEM_ADDR]), MELO_CFG_PE_ENDIANESS, request->byte_order );
+            memory->pattern_length = pattern_length;
+            (void) memcpy(&(memory->pattern[0]), &(request->data.data[MELO_MEMORY_RANGE_SIZE]), pattern_length);
+
+            if (request->subfunction == MELO_MEMORY_FILL)
+            {
+                _melo_operation_start(ctx, _melo_memory_fill_step);
+            }
+            else
+            {
+                /* Every position where the whole pattern fits, the response starts with the number of matches */
+                memory->remaining = (memory->remaining >= pattern_length) ? (memory->remaining - pattern_length + 1u) : 0u;
+                response->data.data[0] = 0;
+                response->data.length  = 1;
+                response->byte_order   = request->byte_order;
+                _melo_operation_start(ctx, _melo_memory_search_step);
+            }
+
+            result = true;
+        }
+        else if ( (request->subfunction == MELO_MEMORY_COPY) && (request->data.length == MELO_MEMORY_COPY_SIZE) )
+        {
+            memory->destination = ctx->callbacks->create_pointer( ctx, address );
+            memory->source      = ctx->callbacks->create_pointer( ctx, _melo_esafe_uint32( &(request->data.data[MELO_SIZE_OF_MEM_ADDR]), MELO_CFG_PE_ENDIANESS, request->byte_order ) );
+            memory->remaining   = _melo_esafe_uint32( &(request->data.data[MELO_MEMORY_RANGE_SIZE]), MELO_CFG_PE_ENDIANESS, request->byte_order );
+
+            if (memory->destination > memory->source)
+            {
+                /* Copy from the end so an overlapping source is read before it is overwritten */
+                memory->destination += memory->remaining;
+                memory->source      += memory->remaining;
+                memory->backward     = true;
+            }
+            else
+            {
+                /* Do nothing - copy from the start */
+            }
+
+            _melo_operation_start(ctx, _melo_memory_copy_step);
+            result = true;
+        }
+        else
+        {
+            /* Error - invalid subfunction or length */
+        }
+    }
+
+    return result;
+}
+
+static bool _service_memory_modify(MeloContext * const ctx, const MeloMessage * const request, MeloMessage * const response)
+{
+    /*
+        Request:  address (4) | width (1) | mask (width) | value (width)
+        Response: 0x45
+
+        The bits set in the mask are replaced by those of the value, the others keep their
+        current state. The read and the write are done with MELO_CFG_ENTER_CRITICAL held, so
+        an interrupt cannot change the other bits in between.
+    */
+    bool           result = false;
+    _melo_data_ptr data_ptr;
+    _melo_data_ptr mask;
+
+    data_ptr.size = request->data.data[MELO_SIZE_OF_MEM_ADDR];
+
+    if ( ( (data_ptr.size == MELO_RW_SIZE_OF_BYTE) || (data_ptr.size == MELO_RW_SIZE_OF_WORD) || (data_ptr.size == MELO_RW_SIZE_OF_DWORD) ) &&
+         (request->data.length == (MELO_MEMORY_MODIFY_HEADER_SIZE + (2u * data_ptr.size))) )
+    {
+        data_ptr.byte_ptr = ctx->callbacks->create_pointer( ctx, _melo_esafe_uint32( &(request->data.data[0]), MELO_CFG_PE_ENDIANESS, request->byte_order ) );
+
+        if (data_ptr.size == MELO_RW_SIZE_OF_BYTE)
+        {
+            mask.byte_val     = request->data.data[MELO_MEMORY_MODIFY_HEADER_SIZE];
+            data_ptr.byte_val = request->data.data[MELO_MEMORY_MODIFY_HEADER_SIZE + 1u] & mask.byte_val;
+
+            MELO_CFG_ENTER_CRITICAL();
+            *(data_ptr.byte_ptr) = (uint8_t) ((*(data_ptr.byte_ptr) & ~mask.byte_val) | data_ptr.byte_val);
+            MELO_CFG_EXIT_CRITICAL();
+        }
+        else if (data_ptr.size == MELO_RW_SIZE_OF_WORD)
+        {
+            mask.word_val     = _melo_esafe_uint16( &(request->data.data[MELO_MEMORY_MODIFY_HEADER_SIZE]), MELO_CFG_PE_ENDIANESS, request->byte_order );
+            data_ptr.word_val = _melo_esafe_uint16( &(request->data.data[MELO_MEMORY_MODIFY_HEADER_SIZE + MELO_RW_SIZE_OF_WORD]), MELO_CFG_PE_ENDIANESS, request->byte_order ) & mask.word_val;
+
+            MELO_CFG_ENTER_CRITICAL();
+            *(data_ptr.word_ptr) = (uint16_t) ((*(data_ptr.word_ptr) & ~mask.word_val) | data_ptr.word_val);
+            MELO_CFG_EXIT_CRITICAL();
+        }
+        else
+        {
+            mask.dword_val     = _melo_esafe_uint32( &(request->data.data[MELO_MEMORY_MODIFY_HEADER_SIZE]), MELO_CFG_PE_ENDIANESS, request->byte_order );
+            data_ptr.dword_val = _melo_esafe_uint32( &(request->data.data[MELO_MEMORY_MODIFY_HEADER_SIZE + MELO_RW_SIZE_OF_DWORD]), MELO_CFG_PE_ENDIANESS, request->byte_order ) & mask.dword_val;
+
+            MELO_CFG_ENTER_CRITICAL();
+            *(data_ptr.dword_ptr) = (*(data_ptr.dword_ptr) & ~mask.dword_val) | data_ptr.dword_val;
+            MELO_CFG_EXIT_CRITICAL();
+        }
+
+        response->data.length  = 1;
+        response->data.data[0] = 0x45;
+        result = true;
+    }
+    else
+    {
+        /* Error - invalid width or length */
+    }
+
+    return result;
+}
+
+static uint16_t _melo_memory_chunk(const _m_memory * const memory)
+{
+    return (memory->remaining < MELO_CFG_MEMORY_CHUNK) ? (uint16_t) memory->remaining : MELO_CFG_MEMORY_CHUNK;
+}
+
+static void _melo_memory_fill_step(MeloContext * const ctx)
+{
+    _m_memory * const memory = &(ctx->memory);
+    uint16_t          chunk  = _melo_memory_chunk(memory);
+    uint16_t          index;
+
+    for (index = 0; index < chunk; index++)
+    {
+        memory->destination[index] = memory->pattern[memory->phase];
+
+        memory->phase++;
+        if (memory->phase == memory->pattern_length)
+        {
+            memory->phase = 0;
+        }
+        else
+        {
+            /* Do nothing - continue the pattern */
+        }
+    }
+
+    memory->destination += chunk;
+    memory->remaining   -= chunk;
+
+    if (memory->remaining == 0)
+    {
+        _melo_operation_complete(ctx, true);
+    }
+    else
+    {
+        /* Do nothing - continued on the next call */
+    }
+}
+
+static void _melo_memory_copy_step(MeloContext * const ctx)
+{
+    _m_memory * const memory = &(ctx->memory);
+    uint16_t          chunk  = _melo_memory_chunk(memory);
+
+    if (memory->backward != false)
+    {
+        memory->destination -= chunk;
+        memory->source      -= chunk;
+        (void) memmove(memory->destination, memory->source, chunk);
+    }
+    else
+    {
+        (void) memmove(memory->destination, memory->source, chunk);
+        memory->destination += chunk;
+        memory->source      += chunk;
+    }
+
+    memory->remaining -= chunk;
+
+    if (memory->remaining == 0)
+    {
+        _melo_operation_complete(ctx, true);
+    }
+    else
+    {
+        /* Do nothing - continued on the next call */
+    }
+}
+
+static void _melo_memory_search_step(MeloContext * const ctx)
+{
+    _m_memory * const memory  = &(ctx->memory);
+    MeloList  * const matches = &(ctx->send_frame.frame.packet.data);
+    uint16_t          chunk   = _melo_memory_chunk(memory);
+    uint16_t          index;
+    bool              full    = false;
+
+    for (index = 0; (index < chunk) && (full == false); index++)
+    {
+        if (memcmp(&(memory->source[index]), &(memory->pattern[0]), memory->pattern_length) == 0)
+        {
+            /* Returned in the byte order of the request */
+            _melo_esafe_copy(&(matches->data[matches->length]), (const uint8_t *) &(memory->address), MELO_MEMORY_MATCH_SIZE, MELO_RW_SIZE_OF_DWORD, MELO_CFG_PE_ENDIANESS, memory->byte_order);
+            matches->length += MELO_MEMORY_MATCH_SIZE;
+            matches->data[0]++;
+
+            full = ( (matches->length + MELO_MEMORY_MATCH_SIZE) > MELO_CFG_MAX_DATA_LENGTH ) ? true : false;
+        }
+        else
+        {
+            /* Do nothing - no match here */
+        }
+
+        memory->address++;
+    }
+
+    memory->source    += index;
+    memory->remaining -= index;
+
+    if ( (memory->remaining == 0) || (full != false) )
+    {
+        /* A full response ends the search, the master continues after the last match */
+        _melo_operation_complete(ctx, true);
+    }
+    else
+    {
+        /* Do nothing - continued on the next call */
+    }
+}
+#endif
+
+#ifdef MELO_CFG_WAIT
+static bool _service_wait(MeloContext * const ctx, const MeloMessage * const request, MeloMessage * const response)
+{
+    /*
+        Request:  address (4) | width (1) | mask (width) | value (width) | timeout in ms (2)
+        Response: the masked value (width), negative when the timeout passed first
+
+        The subfunction is the comparison of (memory & mask) with the value. It is checked on
+        every MeloBackground call, a timeout of 0 checks it once.
+    */
+    bool      result = false;
+    _m_wait * wait   = &(ctx->wait);
+    uint8_t   width  = 0;
+
+    response->data.length = 0;
+
+    if (request->data.length > MELO_SIZE_OF_MEM_ADDR)
+    {
+        width = request->data.data[MELO_SIZE_OF_MEM_ADDR];
+    }
+    else
+    {
+        /* Error - request is too short */
+    }
+
+    if ( ( (width == MELO_RW_SIZE_OF_BYTE) || (width == MELO_RW_SIZE_OF_WORD) || (width == MELO_RW_SIZE_OF_DWORD) ) &&
+         (request->data.length == (MELO_WAIT_HEADER_SIZE + (2u * width) + MELO_WAIT_TIMEOUT_SIZE)) &&
+         (request->subfunction <= MELO_WAIT_GREATER_EQUAL) && (_melo_operation_pending(ctx) == false) )
+    {
+        wait->address    = ctx->callbacks->create_pointer( ctx, _melo_esafe_uint32( &(request->data.data[0]), MELO_CFG_PE_ENDIANESS, request->byte_order ) );
+        wait->mask       = _melo_wait_value( &(request->data.data[MELO_WAIT_HEADER_SIZE]), width, MELO_CFG_PE_ENDIANESS, request->byte_order );
+        wait->value      = _melo_wait_value( &(request->data.data[MELO_WAIT_HEADER_SIZE + width]), width, MELO_CFG_PE_ENDIANESS, request->byte_order );
+        wait->timeout    = _melo_esafe_uint16( &(request->data.data[MELO_WAIT_HEADER_SIZE + (2u * width)]), MELO_CFG_PE_ENDIANESS, request->byte_order );
+        wait->width      = width;
+        wait->compare    = request->subfunction;
+        wait->byte_order = request->byte_order;
+
+        _melo_operation_start(ctx, _melo_wait_step);
+        result = true;
+    }
+    else
+    {
+        /* Error - malformed request or an operation is in progress */
+    }
+
+    return result;
+}
+
+static uint32_t _melo_wait_value(const uint8_t * const bytes, const uint8_t width, const uint8_t pe, const uint8_t he)
+{
+    uint32_t value;
+
+    if (width == MELO_RW_SIZE_OF_BYTE)
+    {
+        value = bytes[0];
+    }
+    else if (width == MELO_RW_SIZE_OF_WORD)
+    {
+        value = _melo_esafe_uint16(bytes, pe, he);
+    }
+    else
+    {
+        value = _melo_esafe_uint32(bytes, pe, he);
+    }
+
+    return value;
+}
+
+static void _melo_wait_step(MeloContext * const ctx)
+{
+    _m_wait  * const wait   = &(ctx->wait);
+    MeloList * const result = &(ctx->send_frame.frame.packet.data);
+    uint32_t         current;
+    bool             met;
+    _melo_data_ptr   data_ptr;
+
+    /* Read the variable in one access, it may be changed by an interrupt */
+    _melo_copy_value(&(data_ptr.byte_val), wait->address, wait->width);
+
+    if (wait->width == MELO_RW_SIZE_OF_BYTE)
+    {
+        current = data_ptr.byte_val;
+    }
+    else if (wait->width == MELO_RW_SIZE_OF_WORD)
+    {
+        current = data_ptr.word_val;
+    }
+    else
+    {
+        current = data_ptr.dword_val;
+    }
+
+    current &= wait->mask;
+
+    if (wait->compare == MELO_WAIT_EQUAL)
+    {
+        met = (current == wait->value) ? true : false;
+    }
+    else if (wait->compare == MELO_WAIT_NOT_EQUAL)
+    {
+        met = (current != wait->value) ? true : false;
+    }
+    else if (wait->compare == MELO_WAIT_LESS)
+    {
+        met = (current < wait->value) ? true : false;
+    }
+    else if (wait->compare == MELO_WAIT_LESS_EQUAL)
+    {
+        met = (current <= wait->value) ? true : false;
+    }
+    else if (wait->compare == MELO_WAIT_GREATER)
+    {
+        met = (current > wait->value) ? true : false;
+    }
+    else
+    {
+        met = (current >= wait->value) ? true : false;
+    }
+
+    if ( (met != false) || (wait->timeout == 0) )
+    {
+        /* Returned in the byte order of the request */
+        if (wait->width == MELO_RW_SIZE_OF_BYTE)
+        {
+            data_ptr.byte_val = (uint8_t) current;
+        }
+        else if (wait->width == MELO_RW_SIZE_OF_WORD)
+        {
+            data_ptr.word_val = (uint16_t) current;
+        }
+        else
+        {
+            data_ptr.dword_val = current;
+        }
+
+        _melo_esafe_copy( &(result->data[0]), &(data_ptr.byte_val), wait->width, wait->width, MELO_CFG_PE_ENDIANESS, wait->byte_order );
+        result->length = wait->width;
+
+        _melo_operation_complete(ctx, met);
+    }
+    else
+    {
+        /* Do nothing - checked again on the next call */
+    }
+}
+#endif
+
+static bool _melo_daq_pending(const MeloContext * const ctx)
+{
+#ifdef MELO_CFG_DAQ
+    return (ctx->daq_pending != 0) ? true : false;
+#else
+    (void) ctx;
+    return false;
+#endif
+}
+
+static void _melo_daq_notify_pending(MeloContext * const ctx)
+{
+    /* Samples taken while a response was in progress are sent now */
+    if (_melo_daq_pending(ctx) != false)
+    {
+        _notify_event(ctx, MELO_EVENT_DAQ_TRIGGER);
+    }
+    else
     {
-        element = _m_event_stack.data[_m_event_stack.length];
-        _m_event_stack.length--;
+        /* Do nothing - no sample waiting */
     }
+}
 
-    return element;
+static void _melo_daq_transmit(MeloContext * const ctx)
+{
+#ifdef MELO_CFG_DAQ
+    uint8_t index;
+
+    for (index = 0; (index < MELO_CFG_DAQ_LISTS) && (IS_BIT_SET(ctx->daq_pending, index) == false); index++)
+    {
+        /* Do nothing - searching for the first pending list */
+    }
+
+    if (index < MELO_CFG_DAQ_LISTS)
+    {
+        ctx->daq_frame.frame.packet.command.raw_byte           = 0x00;
+        ctx->daq_frame.frame.packet.command.fields.service     = MELO_SERVICE_DAQ;
+        ctx->daq_frame.frame.packet.command.fields.subfunction = MELO_DAQ_SAMPLE;
+        ctx->daq_frame.frame.packet.command.fields.status      = MELO_CMD_POSITIVE_RESPONSE;
+        ctx->daq_frame.frame.packet.byte_order                 = MELO_CFG_PE_ENDIANESS;
+        ctx->daq_frame.frame.packet.cobs                       = MELO_TX_COBS;
+        ctx->daq_frame.frame.packet.ext_flags                  = 0;
+        ctx->daq_frame.frame.packet.data.data                  = &(ctx->daq_lists[index].sample[0]);
+        ctx->daq_frame.frame.packet.data.length                = ctx->daq_lists[index].sample_length;
+
+        /* Unsolicited frames are always protected */
+        ctx->daq_frame.crc_present = true;
+
+        _melo_serialize_frame( &(ctx->daq_frame) );
+
+        /* The sample was copied into the frame, the list may be sampled again */
+        MELO_CFG_ENTER_CRITICAL();
+        BIT_CLEAR(ctx->daq_pending, index);
+        MELO_CFG_EXIT_CRITICAL();
+    }
+    else
+    {
+        ctx->daq_frame.buffer.length = 0;
+    }
+
+    _melo_transmit_frame(ctx, &(ctx->daq_frame));
+#else
+    (void) ctx;
+#endif
+}
+
+static bool _melo_segment_pending(const MeloContext * const ctx)
+{
+#ifdef MELO_CFG_SEGMENT
+    /* A read released by flow control, once the separation time has passed */
+    return ( (ctx->segment.mode == MELO_SEGMENT_READ) && (ctx->segment.gap == 0) ) ? true : false;
+#else
+    (void) ctx;
+    return false;
+#endif
+}
+
+static void _melo_segment_notify_pending(MeloContext * const ctx)
+{
+    if (_melo_segment_pending(ctx) != false)
+    {
+        _notify_event(ctx, MELO_EVENT_SEGMENT);
+    }
+    else
+    {
+        /* Do nothing - no consecutive frame due */
+    }
+}
+
+static void _melo_segment_transmit(MeloContext * const ctx)
+{
+#ifdef MELO_CFG_SEGMENT
+    _m_segment * const segment = &(ctx->segment);
+    uint8_t            chunk;
+
+    if (_melo_segment_pending(ctx) != false)
+    {
+        chunk = (segment->remaining < (MELO_CFG_MAX_DATA_LENGTH - MELO_SEGMENT_SEQUENCE_SIZE)) ? (uint8_t) segment->remaining : (uint8_t) (MELO_CFG_MAX_DATA_LENGTH - MELO_SEGMENT_SEQUENCE_SIZE);
+
+        ctx->segment_frame.frame.packet.command.raw_byte           = 0x00;
+        ctx->segment_frame.frame.packet.command.fields.service     = MELO_SERVICE_TRANSFER;
+        ctx->segment_frame.frame.packet.command.fields.subfunction = MELO_TRANSFER_CONSECUTIVE;
+        ctx->segment_frame.frame.packet.command.fields.status      = MELO_CMD_POSITIVE_RESPONSE;
+        ctx->segment_frame.frame.packet.byte_order                 = MELO_CFG_PE_ENDIANESS;
+        ctx->segment_frame.frame.packet.cobs                       = segment->cobs;
+        ctx->segment_frame.frame.packet.ext_flags                  = 0;
+        ctx->segment_frame.crc_present                             = segment->crc_present;
+
+        ctx->segment_frame.frame.packet.data.data[0] = segment->sequence;
+        (void) memcpy(&(ctx->segment_frame.frame.packet.data.data[MELO_SEGMENT_SEQUENCE_SIZE]), segment->address, chunk);
+        ctx->segment_frame.frame.packet.data.length = MELO_SEGMENT_SEQUENCE_SIZE + chunk;
+
+        _melo_serialize_frame( &(ctx->segment_frame) );
+
+        segment->address   += chunk;
+        segment->remaining -= chunk;
+        segment->sequence   = (segment->sequence + 1u) & MELO_SEGMENT_SEQUENCE_MASK;
+
+        if (segment->remaining == 0)
+        {
+            segment->mode = MELO_SEGMENT_IDLE;
+        }
+        else if (segment->block == 1u)
+        {
+            /* End of the block, the master's next flow control releases the following one */
+            segment->mode = MELO_SEGMENT_READ_WAIT;
+        }
+        else
+        {
+            /* Do nothing - more frames follow */
+        }
+
+        if (segment->block > 0)
+        {
+            segment->block--;
+        }
+        else
+        {
+            /* Do nothing - no block limit */
+        }
+
+        /* The separation time only matters when another frame of this block follows */
+        segment->gap = (_melo_segment_pending(ctx) != false) ? segment->st_min : 0u;
+    }
+    else
+    {
+        ctx->segment_frame.buffer.length = 0;
+    }
+
+    _melo_transmit_frame(ctx, &(ctx->segment_frame));
+#else
+    (void) ctx;
+#endif
+}
+
+static void _melo_wait_tick(MeloContext * const ctx, const uint16_t elapsed)
+{
+#ifdef MELO_CFG_WAIT
+    ctx->wait.timeout = (elapsed < ctx->wait.timeout) ? (uint16_t) (ctx->wait.timeout - elapsed) : 0u;
+#else
+    (void) ctx;
+    (void) elapsed;
+#endif
+}
+
+static void _melo_segment_tick(MeloContext * const ctx, const uint16_t elapsed)
+{
+#ifdef MELO_CFG_SEGMENT
+    if (ctx->segment.gap > 0)
+    {
+        ctx->segment.gap = (elapsed < ctx->segment.gap) ? (uint16_t) (ctx->segment.gap - elapsed) : 0u;
+
+        /* The separation time has passed, the next consecutive frame is due */
+        _melo_segment_notify_pending(ctx);
+    }
+    else
+    {
+        /* Do nothing - no separation time running */
+    }
+#else
+    (void) ctx;
+    (void) elapsed;
+#endif
+}
+
+static uint16_t _melo_segment_deadline(const MeloContext * const ctx, const uint16_t deadline)
+{
+    uint16_t result = deadline;
+
+#ifdef MELO_CFG_SEGMENT
+    if ( (ctx->segment.gap > 0) && (ctx->segment.gap < deadline) )
+    {
+        result = ctx->segment.gap;
+    }
+    else
+    {
+        /* Do nothing - the state machine's deadline is nearer */
+    }
+#else
+    (void) ctx;
+#endif
+
+    return result;
+}
+
+#ifdef MELO_OPERATION_ENABLED
+static void _melo_operation_start(MeloContext * const ctx, const _m_operation_step step)
+{
+    ctx->operation.step    = step;
+    ctx->operation.done    = false;
+    ctx->operation.pending = true;
+    ctx->reply             = MELO_REPLY_DEFERRED;
+}
+
+#ifdef MELO_CFG_FLASH
+static void _melo_operation_cancel(MeloContext * const ctx)
+{
+    ctx->operation.pending = false;
+    ctx->reply             = MELO_REPLY_NOW;
+}
+#endif
+
+static void _melo_operation_complete(MeloContext * const ctx, const bool success)
+{
+    ctx->operation.success = success;
+    ctx->operation.done    = true;
+
+    _notify_event(ctx, MELO_EVENT_OPERATION_DONE);
+}
+#endif
+
+static bool _melo_operation_pending(const MeloContext * const ctx)
+{
+    return ctx->operation.pending;
+}
+
+static bool _melo_operation_done(const MeloContext * const ctx)
+{
+    return ctx->operation.done;
+}
+
+static void _melo_operation_notify_done(MeloContext * const ctx)
+{
+    /* The operation may have completed while its pending frame was sent */
+    if (_melo_operation_done(ctx) != false)
+    {
+        _notify_event(ctx, MELO_EVENT_OPERATION_DONE);
+    }
+    else
+    {
+        /* Do nothing - still busy */
+    }
+}
+
+static void _melo_operation_step(MeloContext * const ctx)
+{
+    if ( (ctx->operation.pending != false) && (ctx->operation.done == false) && (ctx->operation.step != NULL) )
+    {
+        ctx->operation.step(ctx);
+    }
+    else
+    {
+        /* Do nothing - no operation runs in the background */
+    }
+}
+
+static uint16_t _melo_operation_deadline(const MeloContext * const ctx, const uint16_t deadline)
+{
+    uint16_t result = deadline;
+
+    /* An operation run from MeloBackground needs it to be called again right away */
+    if ( (ctx->operation.pending != false) && (ctx->operation.done == false) && (ctx->operation.step != NULL) )
+    {
+        result = 0;
+    }
+    else
+    {
+        /* Do nothing - waiting for events or the application */
+    }
+
+    return result;
+}
+
+static void _melo_operation_respond(MeloContext * const ctx)
+{
+    /* The response frame still holds the command, tag and framing of the request */
+    if (ctx->operation.success == false)
+    {
+        /* Any data is kept, e.g. the last value read by a wait */
+        ctx->send_frame.frame.packet.command.fields.status = MELO_CMD_NEGATIVE_RESPONSE;
+    }
+    else if (ctx->send_frame.frame.packet.data.length == 0)
+    {
+        /* No result, acknowledge like a write */
+        ctx->send_frame.frame.packet.command.fields.status = MELO_CMD_POSITIVE_RESPONSE;
+        ctx->send_frame.frame.packet.data.data[0]          = 0x45;
+        ctx->send_frame.frame.packet.data.length           = 1;
+    }
+    else
+    {
+        ctx->send_frame.frame.packet.command.fields.status = MELO_CMD_POSITIVE_RESPONSE;
+    }
+
+    ctx->operation.pending = false;
+    ctx->operation.done    = false;
+
+    _melo_serialize_frame( &(ctx->send_frame) );
+    _melo_transmit_frame(ctx, &(ctx->send_frame));
+}
+
+static void _melo_create_r(uint8_t * const b)
+{
+	*b = ((*b & RESERVED_TX_HIGH_MASK) << 1u) | (*b & RESERVED_LOW_MASK);
+}
+
+static void _melo_restore_r(uint8_t * const b)
+{
+	*b = ((*b & RESERVED_RX_HIGH_MASK) >> 1u) | (*b & RESERVED_LOW_MASK);
+}
+
+static void _melo_dispatch_events(MeloContext * const ctx)
+{
+    uint8_t event;
+
+    for (event = _get_event(ctx); event != MELO_EVENT_IDLE; event = _get_event(ctx))
+    {
+        ctx->sm.current = _state_dispatch(ctx, event);
+    }
 }
 
-static void _init_event_stack(void)
+static uint8_t _get_event(MeloContext * const ctx)
 {
-    _m_event_stack.data   = &_m_event_stack_data[0];
-    _m_event_stack.size   = MELO_CFG_MAX_STACK_SIZE;
-    _m_event_stack.length = 0;
+    uint8_t element;
+    uint8_t tail = ctx->events.tail;
+
+    if (ctx->events.head == tail)
+    {
+        element = MELO_EVENT_IDLE;
+    }
+    else
+    {
+        /* Read the event before releasing the slot to the producer */
+        element = ctx->events.data[tail & MELO_EVENT_QUEUE_MASK];
+        ctx->events.tail = (uint8_t) (tail + 1u);
+    }
+
+    return element;
 }
 
-static void _melo_create_cmd_byte(uint8_t * const b, const uint8_t cmd_type)
+static void _melo_create_cmd_byte(uint8_t * const b, const uint8_t cmd_type, const uint8_t byte_order)
 {
     BIT_SET(*b, FRAME_RESERVED_BIT_POS);
 
-    if (MELO_CFG_PE_ENDIANESS == MELO_BIG_ENDIAN)
+    if (byte_order == MELO_BIG_ENDIAN)
     {
         BIT_SET(*b, FRAME_ENDIAN_BIT_POS);
     }
@@ -465,13 +2612,117 @@ static void _melo_create_cmd_byte(uint8_t * const b, const uint8_t cmd_type)
     }
     else
     {
-        BIT_CLEAR(*b, FRAME_MARKER_BIT_POS);
+        BIT_CLEAR(*b, FRAME_MARKER_BIT_POS);
+    }
+}
+
+static void _melo_receive(MeloContext * const ctx, const uint8_t byte)
+{
+    const uint8_t head      = ctx->recv_head;
+    const bool    cobs_body = ctx->recv_cobs;
+    bool          complete;
+
+    if (cobs_body != false)
+    {
+        /* Inside a COBS frame every byte is data up to the delimiter */
+        if (byte == MELO_COBS_DELIMITER)
+        {
+            ctx->recv_cobs = false;
+        }
+        else
+        {
+            /* Do nothing - frame continues */
+        }
+    }
+    else if ( (IS_FRAME_CONTROL(byte) != false) && (IS_FRAME_ESCAPED(byte) == false) && (IS_FRAME_HEAD(byte) != false) )
+    {
+        ctx->recv_cobs = IS_FRAME_COBS(byte);
+
+        /* A new frame starts - claim the next free receive buffer */
+        if ( ((uint8_t) (head - ctx->recv_tail)) < MELO_CFG_RX_FRAME_COUNT )
+        {
+            ctx->recv_frame = &(ctx->recv_frames[head & MELO_RX_FRAME_MASK]);
+        }
+        else
+        {
+            /* Error - every buffer holds an unprocessed frame, drop this one */
+            ctx->recv_frame = NULL;
+        }
+    }
+    else
+    {
+        /* Do nothing - continue the current frame */
+    }
+
+    if (ctx->recv_frame != NULL)
+    {
+        if (cobs_body != false)
+        {
+            complete = _melo_rx_cobs_byte(ctx->recv_frame, byte);
+        }
+        else
+        {
+            complete = _melo_rx_byte(ctx->recv_frame, byte);
+        }
+
+        if (complete != false)
+        {
+            /* Hand the completed frame over to the state machine */
+            ctx->recv_frame = NULL;
+            ctx->recv_head  = (uint8_t) (head + 1u);
+
+            _notify_event(ctx, MELO_EVENT_REQUEST_RECEIVED);
+        }
+        else
+        {
+            /* Do nothing - frame incomplete */
+        }
+    }
+    else
+    {
+        /* Do nothing - no frame is being received */
+    }
+}
+
+static bool _melo_rx_pending(const MeloContext * const ctx)
+{
+    return (ctx->recv_head != ctx->recv_tail) ? true : false;
+}
+
+static void _melo_rx_notify_pending(MeloContext * const ctx)
+{
+    /* Frames received while a response was in progress are processed now */
+    if (_melo_rx_pending(ctx) != false)
+    {
+        _notify_event(ctx, MELO_EVENT_REQUEST_RECEIVED);
+    }
+    else
+    {
+        /* Do nothing - no frame waiting */
+    }
+}
+
+static void _melo_process_frame(MeloContext * const ctx)
+{
+    const uint8_t tail = ctx->recv_tail;
+
+    if (_melo_rx_pending(ctx) != false)
+    {
+        _melo_frame_handler(ctx, &(ctx->recv_frames[tail & MELO_RX_FRAME_MASK].frame), ctx->recv_frames[tail & MELO_RX_FRAME_MASK].crc_present);
+
+        /* Release the buffer to the receiver */
+        ctx->recv_tail = (uint8_t) (tail + 1u);
+    }
+    else
+    {
+        /* Do nothing - no frame waiting */
     }
 }
 
-static void _melo_rx_byte(_m_frame_buffer * const frame_buffer, const uint8_t byte)
+static bool _melo_rx_byte(_m_frame_buffer * const frame_buffer, const uint8_t byte)
 {
-    uint8_t index = 0;
+    bool    complete  = false;
+    uint8_t data_byte = byte;
 
     if (IS_FRAME_CONTROL(byte) != false)
     {
@@ -482,52 +2733,29 @@ static void _melo_rx_byte(_m_frame_buffer * const frame_buffer, const uint8_t by
         }
         else if (IS_FRAME_HEAD(byte) != false)
         {
-            /* Reset receive buffer */
-            for (frame_buffer->buffer.length = 0;
-                 frame_buffer->buffer.length < frame_buffer->buffer.size;
-                 frame_buffer->buffer.length++)
-            {
-                frame_buffer->buffer.data[frame_buffer->buffer.length] = 0x00;
-            }
+            /* Reset receive buffer - the contents are overwritten in place */
             frame_buffer->buffer.length = 0;
+            frame_buffer->escape_buffer = 0;
+            frame_buffer->cobs_zero     = false;
 
             /* Load configuration values */
+            frame_buffer->crc                     = MELO_CRC_INIT;
             frame_buffer->crc_present             = IS_FRAME_CRC_PRESENT(byte);
+            frame_buffer->ext_present             = IS_FRAME_EXT_PRESENT(byte);
             frame_buffer->frame.packet.byte_order = GET_FRAME_ENDIANNESS(byte);
+            frame_buffer->frame.packet.cobs       = IS_FRAME_COBS(byte);
         }
         else if (IS_FRAME_TAIL(byte) != false)
         {
             /* Check consistency between HEAD and TAIL */
             if (
                  ( frame_buffer->crc_present             == IS_FRAME_CRC_PRESENT(byte) ) &&
-                 ( frame_buffer->frame.packet.byte_order == GET_FRAME_ENDIANNESS(byte) )
+                 ( frame_buffer->ext_present             == IS_FRAME_EXT_PRESENT(byte) ) &&
+                 ( frame_buffer->frame.packet.byte_order == GET_FRAME_ENDIANNESS(byte) ) &&
+                 ( frame_buffer->frame.packet.cobs       == false                       )
                )
             {
-                /* Process receive buffer */
-                if (frame_buffer->crc_present != false)
-                {
-                    /* CRC precedes the TAIL by one byte */
-                    frame_buffer->frame.crc = frame_buffer->buffer.data[frame_buffer->buffer.length - 1u];
-                }
-                else
-                {
-                    /* Do nothing - no CRC is present to process */
-                    frame_buffer->frame.crc = 0x00;
-                }
-
-                /* Unpack the rest of the data */
-                frame_buffer->frame.packet.data.length = frame_buffer->buffer.data[0];
-                _melo_restore_r( &(frame_buffer->frame.packet.data.length) );
-
-                frame_buffer->frame.packet.command.raw_byte = frame_buffer->buffer.data[1];
-
-                for (index = 0; index < frame_buffer->frame.packet.data.length; index++)
-                {
-                    frame_buffer->frame.packet.data.data[index] = frame_buffer->buffer.data[2 + index];
-                }
-
-                /* Indicate a packet has been received */
-                _notify_event(MELO_EVENT_REQUEST_RECEIVED);
+                complete = _melo_rx_unpack(frame_buffer);
             }
             else
             {
@@ -541,25 +2769,159 @@ static void _melo_rx_byte(_m_frame_buffer * const frame_buffer, const uint8_t by
     }
     else
     {
-        /* Fill the buffer */
-        /* TODO: NULL CHECK for: frame_buffer->buffer.data or InitComplete */
-        frame_buffer->buffer.data[frame_buffer->buffer.length] = byte;
-
         /* Escape handling */
         if ( (frame_buffer->escape_buffer & 1u) != 0 )
         {
             /* Restore the bit that had been cleared before transmission */
-            BIT_SET(frame_buffer->buffer.data[frame_buffer->buffer.length], FRAME_RESERVED_BIT_POS);
+            BIT_SET(data_byte, FRAME_RESERVED_BIT_POS);
         }
         else
         {
             /* Do nothing - this byte was not escaped */
         }
 
+        _melo_rx_store(frame_buffer, data_byte);
+
         /* Ready for next element */
         frame_buffer->escape_buffer = frame_buffer->escape_buffer >> 1;
+    }
+
+    return complete;
+}
+
+static bool _melo_rx_cobs_byte(_m_frame_buffer * const frame_buffer, const uint8_t byte)
+{
+    bool complete = false;
+
+    /* In a COBS frame escape_buffer counts the data bytes left in the current block */
+    if (byte == MELO_COBS_DELIMITER)
+    {
+        /* The zero owed by the last block is not part of the frame */
+        if (frame_buffer->escape_buffer == 0)
+        {
+            complete = _melo_rx_unpack(frame_buffer);
+        }
+        else
+        {
+            /* Error - the frame ended inside a block */
+        }
+    }
+    else if (frame_buffer->escape_buffer == 0)
+    {
+        /* A code byte - the zero ending the previous block comes first */
+        if (frame_buffer->cobs_zero != false)
+        {
+            _melo_rx_store(frame_buffer, 0x00);
+        }
+        else
+        {
+            /* Do nothing - first block, or the previous block was full */
+        }
+
+        frame_buffer->escape_buffer = byte - 1u;
+        frame_buffer->cobs_zero     = (byte != MELO_COBS_MAX_CODE) ? true : false;
+    }
+    else
+    {
+        _melo_rx_store(frame_buffer, byte);
+        frame_buffer->escape_buffer--;
+    }
+
+    return complete;
+}
+
+static void _melo_rx_store(_m_frame_buffer * const frame_buffer, const uint8_t byte)
+{
+    /* TODO: NULL CHECK for: frame_buffer->buffer.data or InitComplete */
+    if (frame_buffer->buffer.length < frame_buffer->buffer.size)
+    {
+        frame_buffer->buffer.data[frame_buffer->buffer.length] = byte;
+
+        /* Running CRC over the unescaped bytes */
+        frame_buffer->crc = MELO_CRC_UPDATE(frame_buffer->crc, byte);
         frame_buffer->buffer.length++;
     }
+    else
+    {
+        /* Error - frame is too long, it will be rejected at the TAIL */
+    }
+}
+
+static bool _melo_rx_unpack(_m_frame_buffer * const frame_buffer)
+{
+    bool    complete      = false;
+    uint8_t header_length = 0;
+
+    /* Process receive buffer */
+    if (frame_buffer->crc_present != false)
+    {
+        /* The CRC preceding the TAIL has already been run through the CRC, leaving the residue */
+        frame_buffer->frame.crc = frame_buffer->crc;
+    }
+    else
+    {
+        /* Do nothing - no CRC is present to process */
+        frame_buffer->frame.crc = MELO_CRC_RESIDUE;
+    }
+
+    /* Unpack the rest of the data */
+    frame_buffer->frame.packet.data.length = frame_buffer->buffer.data[0];
+    _melo_restore_r( &(frame_buffer->frame.packet.data.length) );
+
+    frame_buffer->frame.packet.command.raw_byte = frame_buffer->buffer.data[1];
+
+    /* Extended header */
+    header_length = MELO_PACKET_SIZE;
+    frame_buffer->frame.packet.ext_flags = 0;
+    frame_buffer->frame.packet.tag       = 0;
+    frame_buffer->frame.packet.service   = frame_buffer->frame.packet.command.fields.service;
+
+    if (frame_buffer->ext_present != false)
+    {
+        frame_buffer->frame.packet.ext_flags = frame_buffer->buffer.data[header_length];
+        header_length++;
+
+        if (IS_BIT_SET(frame_buffer->frame.packet.ext_flags, MELO_EXT_TAG_BIT_POS) != false)
+        {
+            frame_buffer->frame.packet.tag = frame_buffer->buffer.data[header_length];
+            header_length++;
+        }
+        else
+        {
+            /* Do nothing - untagged */
+        }
+
+        if (IS_BIT_SET(frame_buffer->frame.packet.ext_flags, MELO_EXT_SERVICE_BIT_POS) != false)
+        {
+            frame_buffer->frame.packet.service = frame_buffer->buffer.data[header_length];
+            header_length++;
+        }
+        else
+        {
+            /* Do nothing - service is in the command byte */
+        }
+    }
+    else
+    {
+        /* Do nothing - no extended header */
+    }
+
+    if (frame_buffer->frame.crc != MELO_CRC_RESIDUE)
+    {
+        /* Error - Invalid CRC */
+    }
+    else if (frame_buffer->buffer.length == (header_length + frame_buffer->frame.packet.data.length + ((frame_buffer->crc_present != false) ? MELO_CRC_SIZE : 0u)))
+    {
+        /* The data is decoded in place - packet.data.data points into the frame buffer */
+        frame_buffer->frame.packet.data.data = &(frame_buffer->buffer.data[header_length]);
+        complete = true;
+    }
+    else
+    {
+        /* Error - length field does not match the bytes received */
+    }
+
+    return complete;
 }
 
 void _melo_serialize_frame(_m_frame_buffer * const frame_buffer)
@@ -571,40 +2933,103 @@ void _melo_serialize_frame(_m_frame_buffer * const frame_buffer)
     uint8_t data_byte  = 0;
     uint8_t cur_data   = 0;
     uint8_t crc_offset = 0;
+    MeloCrc crc        = MELO_CRC_INIT;
+
+    uint8_t header[MELO_MAX_EXT_SIZE];
+    uint8_t header_length = 0;
+    uint8_t payload_length;
 
     frame_buffer->buffer.length = 0;
 
+    /* Extended header */
+    if (frame_buffer->frame.packet.ext_flags != 0)
+    {
+        header[header_length] = frame_buffer->frame.packet.ext_flags;
+        header_length++;
+
+        if (IS_BIT_SET(frame_buffer->frame.packet.ext_flags, MELO_EXT_TAG_BIT_POS) != false)
+        {
+            header[header_length] = frame_buffer->frame.packet.tag;
+            header_length++;
+        }
+        else
+        {
+            /* Do nothing - untagged */
+        }
+
+        if (IS_BIT_SET(frame_buffer->frame.packet.ext_flags, MELO_EXT_SERVICE_BIT_POS) != false)
+        {
+            header[header_length] = frame_buffer->frame.packet.service;
+            header_length++;
+        }
+        else
+        {
+            /* Do nothing - service is in the command byte */
+        }
+    }
+    else
+    {
+        /* Do nothing - no extended header */
+    }
+
+    payload_length = header_length + frame_buffer->frame.packet.data.length;
+
     /* HEAD */
     frame_buffer->buffer.data[frame_buffer->buffer.length] = 0x00;
-    _melo_create_cmd_byte( &(frame_buffer->buffer.data[frame_buffer->buffer.length]), MELO_CMD_HEAD );
+    _melo_create_cmd_byte( &(frame_buffer->buffer.data[frame_buffer->buffer.length]), MELO_CMD_HEAD, frame_buffer->frame.packet.byte_order );
     frame_buffer->buffer.length++;
 
+    if (frame_buffer->frame.packet.cobs != false)
+    {
+        /* Room for the first COBS code byte, the frame is encoded once complete */
+        BIT_SET(frame_buffer->buffer.data[0], FRAME_COBS_BIT_POS);
+        frame_buffer->buffer.length++;
+    }
+    else
+    {
+        /* Do nothing - escaped framing */
+    }
+
     /* Length */
     frame_buffer->buffer.data[frame_buffer->buffer.length] = frame_buffer->frame.packet.data.length;
     _melo_create_r( &(frame_buffer->buffer.data[frame_buffer->buffer.length]) );
+    crc = MELO_CRC_UPDATE(crc, frame_buffer->buffer.data[frame_buffer->buffer.length]);
     frame_buffer->buffer.length++;
 
     /* Command */
     frame_buffer->buffer.data[frame_buffer->buffer.length] = frame_buffer->frame.packet.command.raw_byte;
+    crc = MELO_CRC_UPDATE(crc, frame_buffer->buffer.data[frame_buffer->buffer.length]);
     frame_buffer->buffer.length++;
 
     /* CRC */
     if (frame_buffer->crc_present != false)
     {
-        frame_buffer->frame.packet.data.data[frame_buffer->frame.packet.data.length] = 0x66;
-        crc_offset = 1u;
+        crc_offset = MELO_CRC_SIZE;
     }
     else
     {
         /* Do nothing - no need to use a CRC */
     }
 
-    /* Data */
-    for (; cur_data < (frame_buffer->frame.packet.data.length + crc_offset); cur_data++)
+    /* Extended header and data, followed by the CRC (MSB first) */
+    for (; cur_data < (payload_length + crc_offset); cur_data++)
     {
-        data_byte = frame_buffer->frame.packet.data.data[cur_data];
+        if (cur_data < header_length)
+        {
+            data_byte = header[cur_data];
+            crc       = MELO_CRC_UPDATE(crc, data_byte);
+        }
+        else if (cur_data < payload_length)
+        {
+            data_byte = frame_buffer->frame.packet.data.data[cur_data - header_length];
+            crc       = MELO_CRC_UPDATE(crc, data_byte);
+        }
+        else
+        {
+            data_byte = (uint8_t) (crc >> (8u * ((payload_length + crc_offset) - (cur_data + 1u))));
+        }
 
-        if ( IS_FRAME_CONTROL(data_byte) )
+        if ( (frame_buffer->frame.packet.cobs == false) && (IS_FRAME_CONTROL(data_byte) != false) )
         {
             /* Data must be escaped */
             if (escape_available != false)
@@ -654,104 +3079,328 @@ void _melo_serialize_frame(_m_frame_buffer * const frame_buffer)
     }
 
     /* CRC & TAIL */
-    frame_buffer->buffer.data[frame_buffer->buffer.length] = 0x00;
-    _melo_create_cmd_byte( &(frame_buffer->buffer.data[frame_buffer->buffer.length]), MELO_CMD_TAIL );
-
     if (frame_buffer->crc_present != false)
     {
         BIT_SET(frame_buffer->buffer.data[0], FRAME_CRC_BIT_POS);
-        BIT_SET(frame_buffer->buffer.data[frame_buffer->buffer.length], FRAME_CRC_BIT_POS);
     }
     else
     {
         /* Do nothing - no need to set CRC flags */
     }
-
-    frame_buffer->buffer.length++;
+
+    if (header_length > 0)
+    {
+        BIT_SET(frame_buffer->buffer.data[0], FRAME_EXT_BIT_POS);
+    }
+    else
+    {
+        /* Do nothing - no need to set extended header flags */
+    }
+
+    if (frame_buffer->frame.packet.cobs != false)
+    {
+        _melo_cobs_encode(frame_buffer);
+
+        frame_buffer->buffer.data[frame_buffer->buffer.length] = MELO_COBS_DELIMITER;
+    }
+    else
+    {
+        /* The TAIL repeats the flags of the HEAD */
+        frame_buffer->buffer.data[frame_buffer->buffer.length] = frame_buffer->buffer.data[0];
+        BIT_CLEAR(frame_buffer->buffer.data[frame_buffer->buffer.length], FRAME_MARKER_BIT_POS);
+    }
+
+    frame_buffer->buffer.length++;
+}
+
+static void _melo_cobs_encode(_m_frame_buffer * const frame_buffer)
+{
+    uint8_t code_index = 1u;
+    uint8_t index;
+
+    /*
+        Encoded in place: the byte after the HEAD was left free for the first code byte, and
+        every zero becomes the code byte of the following block. A frame is never longer than
+        255 bytes, so no block reaches the 254 data bytes that would need another code byte.
+    */
+    for (index = code_index + 1u; index < frame_buffer->buffer.length; index++)
+    {
+        if (frame_buffer->buffer.data[index] == 0x00)
+        {
+            frame_buffer->buffer.data[code_index] = (uint8_t) (index - code_index);
+            code_index = index;
+        }
+        else
+        {
+            /* Do nothing - data byte */
+        }
+    }
+
+    frame_buffer->buffer.data[code_index] = (uint8_t) (frame_buffer->buffer.length - code_index);
+}
+
+static uint8_t _melo_service_handler(MeloContext * const ctx, const _m_packet * const packet, const bool crc_present)
+{
+    bool        success = false;
+    MeloService handler;
+    MeloMessage request;
+    MeloMessage response;
+
+    /* Process request */
+    ctx->send_frame.frame.packet.command.raw_byte = packet->command.raw_byte;
+    ctx->send_frame.frame.packet.ext_flags        = packet->ext_flags;
+    ctx->send_frame.frame.packet.tag              = packet->tag;
+    ctx->send_frame.frame.packet.service          = packet->service;
+    ctx->send_frame.frame.packet.cobs             = packet->cobs;
+
+    /* Respond with a CRC if the request had one */
+    ctx->send_frame.crc_present = crc_present;
+
+    request.subfunction  = packet->command.fields.subfunction;
+    request.byte_order   = packet->byte_order;
+    request.data         = packet->data;
+
+    response.subfunction = request.subfunction;
+    response.byte_order  = MELO_CFG_PE_ENDIANESS;
+    response.data        = ctx->send_frame.frame.packet.data;
+    response.data.length = 0;
+
+    handler = NULL;
+
+    if (packet->service < MELO_CFG_NUM_SERVICES)
+    {
+        handler = _m_services[packet->service];
+    }
+    else
+    {
+        /* Do nothing - no slot for registered services */
+    }
+
+    if ( (handler == NULL) && (packet->service < MELO_BUILTIN_SERVICES) )
+    {
+        handler = (MeloService) MELO_CFG_ROM_READ_WORD( &(_m_builtin_services[packet->service]) );
+    }
+    else
+    {
+        /* Do nothing - registered or unknown service */
+    }
+
+    if (handler != NULL)
+    {
+        success = handler(ctx, &request, &response);
+    }
+    else
+    {
+        /* Error - unknown service */
+    }
+
+    ctx->send_frame.frame.packet.data.length = response.data.length;
+    ctx->send_frame.frame.packet.byte_order  = response.byte_order;
+    ctx->send_frame.frame.packet.command.fields.subfunction = response.subfunction;
+
+    if (success != false)
+    {
+        ctx->send_frame.frame.packet.command.fields.status = MELO_CMD_POSITIVE_RESPONSE;
+    }
+    else
+    {
+        ctx->send_frame.frame.packet.command.fields.status = MELO_CMD_NEGATIVE_RESPONSE;
+    }
+
+    /* Prepare response for Tx */
+    _melo_serialize_frame( &(ctx->send_frame) );
+
+    /* Return size of Tx message, escaped like any other data byte */
+    return ctx->send_frame.buffer.length;
+}
+
+static void _melo_packet_handler(MeloContext * const ctx, const _m_packet * const packet, const bool crc_present)
+{
+    if (packet->command.fields.status == MELO_CMD_REQUEST_RESPONSE)
+    {
+        /* Process incoming request */
+        ctx->wait_frame.frame.packet.command      = packet->command;
+        ctx->wait_frame.frame.packet.command.fields.status = MELO_CMD_PENDING_RESPONSE;
+        ctx->wait_frame.frame.packet.ext_flags    = packet->ext_flags;
+        ctx->wait_frame.frame.packet.tag          = packet->tag;
+        ctx->wait_frame.frame.packet.service      = packet->service;
+        ctx->wait_frame.frame.packet.byte_order   = MELO_CFG_PE_ENDIANESS;
+        ctx->wait_frame.frame.packet.cobs         = packet->cobs;
+
+        ctx->wait_frame.frame.packet.data.length  = 1;
+        ctx->wait_frame.crc_present               = crc_present;
+        ctx->reply                                = MELO_REPLY_NOW;
+        ctx->wait_frame.frame.packet.data.data[0] = _melo_service_handler(ctx, packet, crc_present);
+
+        if (ctx->reply == MELO_REPLY_NONE)
+        {
+            /* e.g. a consecutive frame inside a block */
+            ctx->wait_frame.buffer.length = 0;
+            ctx->send_frame.buffer.length = 0;
+        }
+        else
+        {
+            if (ctx->reply == MELO_REPLY_DEFERRED)
+            {
+                /* The response follows once the operation completes */
+                ctx->wait_frame.frame.packet.data.data[0] = 0;
+                ctx->send_frame.buffer.length             = 0;
+            }
+            else
+            {
+                /* Do nothing - the response is ready */
+            }
+
+            _melo_serialize_frame( &(ctx->wait_frame) );
+
+#ifdef MELO_CFG_DIRECT_RESPONSE
+            if ( (ctx->reply == MELO_REPLY_NOW) && (IS_BIT_SET(packet->ext_flags, MELO_EXT_DIRECT_BIT_POS) != false) )
+            {
+                /* The master reads without being told the length, send the response on its own */
+                ctx->wait_frame.buffer.length = 0;
+            }
+            else
+            {
+                /* Do nothing - announce the response with a pending frame */
+            }
+#endif
+        }
+    }
+    else
+    {
+        /* Nothing to send back for a response */
+        ctx->wait_frame.buffer.length = 0;
+        ctx->send_frame.buffer.length = 0;
+
+#ifdef MELO_CFG_MODE_MASTER
+        if (packet->command.fields.status == MELO_CMD_PENDING_RESPONSE)
+        {
+            /* Processing pending response */
+            if (_melo_match_tag(ctx, packet, false) == false)
+            {
+                /* Error - unknown tag */
+            }
+            else if (packet->data.data[0] > 0)
+            {
+                ctx->callbacks->request_bytes( ctx, packet->data.data[0] );
+            }
+            else
+            {
+                /* Do nothing - the response is delayed, further pending frames follow */
+            }
+        }
+        else if (packet->command.fields.status == MELO_CMD_POSITIVE_RESPONSE)
+        {
+            /* Processing positive response */
+            if ( (packet->service == MELO_SERVICE_DAQ) && (packet->command.fields.subfunction == MELO_DAQ_SAMPLE) )
+            {
+                /* Unsolicited DAQ sample: list | counter | values */
+                if ( (packet->data.length >= MELO_DAQ_SAMPLE_HEADER_SIZE) && (ctx->callbacks->receive_daq != NULL) )
+                {
+                    ctx->callbacks->receive_daq(ctx, packet->data.data[0], packet->data.data[1], &(packet->data.data[MELO_DAQ_SAMPLE_HEADER_SIZE]), packet->data.length - MELO_DAQ_SAMPLE_HEADER_SIZE);
+                }
+                else
+                {
+                    ctx->callbacks->receive_response(ctx, MELO_TAG_NONE, packet->service, packet->command.fields.subfunction, &(packet->data.data[0]), packet->data.length, true, packet->byte_order);
+                }
+            }
+            else if (_melo_match_tag(ctx, packet, true) != false)
+            {
+                ctx->callbacks->receive_response(ctx, (IS_BIT_SET(packet->ext_flags, MELO_EXT_TAG_BIT_POS) != false) ? packet->tag : MELO_TAG_NONE, packet->service, packet->command.fields.subfunction, &(packet->data.data[0]), packet->data.length, true, packet->byte_order);
+            }
+            else
+            {
+                /* Error - unknown tag */
+            }
+        }
+        else
+        {
+            /* Processing negative response */
+            if (_melo_match_tag(ctx, packet, true) != false)
+            {
+                ctx->callbacks->receive_response(ctx, (IS_BIT_SET(packet->ext_flags, MELO_EXT_TAG_BIT_POS) != false) ? packet->tag : MELO_TAG_NONE, packet->service, packet->command.fields.subfunction, &(packet->data.data[0]), packet->data.length, false, packet->byte_order);
+            }
+            else
+            {
+                /* Error - unknown tag */
+            }
+        }
+#endif
+    }
 }
 
-static uint8_t _melo_service_handler(const _m_packet * const packet)
+#ifdef MELO_CFG_MODE_MASTER
+static uint8_t _melo_build_request(uint8_t * buffer, const uint8_t service, const uint8_t subfunction, const MeloList * const request_data, const bool use_crc, const uint8_t ext_flags, const uint8_t tag)
 {
-    uint8_t wait_frame_length;
-    bool    success;
-
-    /* Process request */
-    send_frame.frame.packet.command.raw_byte = packet->command.raw_byte;
+    _m_frame_buffer tx_frame;
 
-    success = service_table[packet->command.fields.service](packet, &(send_frame.frame.packet));
+    tx_frame.frame.packet.command.raw_byte           = 0x00;
+    tx_frame.frame.packet.command.fields.subfunction = subfunction;
+    tx_frame.frame.packet.command.fields.status      = MELO_CMD_REQUEST_RESPONSE;
+    tx_frame.frame.packet.byte_order                 = MELO_CFG_PE_ENDIANESS;
+    tx_frame.frame.packet.cobs                       = MELO_TX_COBS;
+    tx_frame.frame.packet.ext_flags                  = ext_flags;
+    tx_frame.frame.packet.tag                        = tag;
+    tx_frame.frame.packet.service                    = service;
 
-    if (success != false)
+    if (service > MELO_CMD_MAX_SERVICE)
     {
-        send_frame.frame.packet.command.fields.status = MELO_CMD_POSITIVE_RESPONSE;
+        /* The service ID does not fit in the command byte */
+        BIT_SET(tx_frame.frame.packet.ext_flags, MELO_EXT_SERVICE_BIT_POS);
     }
     else
     {
-        send_frame.frame.packet.command.fields.status = MELO_CMD_NEGATIVE_RESPONSE;
+        tx_frame.frame.packet.command.fields.service = service;
     }
 
-    /* TODO: send_frame CRC */
-
-    /* Prepare response for Tx */
-    _melo_serialize_frame(&send_frame);
+    tx_frame.buffer.data              = buffer;
+    tx_frame.frame.packet.data.length = request_data->length;
+    tx_frame.frame.packet.data.data   = request_data->data;
+    tx_frame.crc_present              = use_crc;
 
-    _melo_create_r( &send_frame.buffer.length );
-    wait_frame_length = send_frame.buffer.length;
+    _melo_serialize_frame( &tx_frame );
 
-    /* Return size of Tx message */
-    return wait_frame_length;
+    return tx_frame.buffer.length;
 }
 
-static void _melo_packet_handler(const _m_packet * const packet)
+static bool _melo_match_tag(MeloContext * const ctx, const _m_packet * const packet, const bool release)
 {
-    if (packet->command.fields.status == MELO_CMD_REQUEST_RESPONSE)
-    {
-        /* Process incoming request */
-        wait_frame.frame.packet.command      = packet->command;
-        wait_frame.frame.packet.command.fields.status = MELO_CMD_PENDING_RESPONSE;
+    bool    found = false;
+    uint8_t slot;
 
-        wait_frame.frame.packet.data.length  = 1;
-        wait_frame.crc_present               = false;
-        wait_frame.frame.packet.data.data[0] = _melo_service_handler(packet);
-
-        _melo_serialize_frame( &wait_frame );
-    }
-    else if (packet->command.fields.status == MELO_CMD_PENDING_RESPONSE)
-    {
-        /* Processing pending response */
-#ifdef MELO_CFG_MODE_MASTER
-        MeloRequestBytes( packet->data.data[0] );
-#endif
-    }
-    else if (packet->command.fields.status == MELO_CMD_POSITIVE_RESPONSE)
-    {
-        /* Processing positive response */
-#ifdef MELO_CFG_MODE_MASTER
-        MeloReceiveResponse(packet->command.fields.service, packet->command.fields.subfunction, &(packet->data.data[0]), packet->data.length, true);
-#endif
-    }
-    else if (packet->command.fields.status == MELO_CMD_NEGATIVE_RESPONSE)
+    if (IS_BIT_SET(packet->ext_flags, MELO_EXT_TAG_BIT_POS) != false)
     {
-        /* Processing negative response */
-#ifdef MELO_CFG_MODE_MASTER
-        MeloReceiveResponse(packet->command.fields.service, packet->command.fields.subfunction, &(packet->data.data[0]), packet->data.length, false);
-#endif
+        for (slot = 0; (slot < MELO_CFG_MAX_OUTSTANDING) && (found == false); slot++)
+        {
+            if ( (ctx->outstanding[slot].used != false) && (ctx->outstanding[slot].tag == packet->tag) )
+            {
+                ctx->outstanding[slot].used = !release;
+                found = true;
+            }
+            else
+            {
+                /* Do nothing - different request */
+            }
+        }
     }
     else
     {
-        /* Do nothing - invalid status */
+        /* Untagged responses belong to MeloServiceRequestBuilder requests */
+        found = true;
     }
+
+    return found;
 }
+#endif
 
-static void _melo_frame_handler(const _m_frame * const frame, const bool crc_present)
+static void _melo_frame_handler(MeloContext * const ctx, const _m_frame * const frame, const bool crc_present)
 {
-    bool crc_valid = false;
-
     if (crc_present != false)
     {
         /* Run CRC check */
-        if (crc_valid != false)
+        if (frame->crc == MELO_CRC_RESIDUE)
         {
-            _melo_packet_handler( &(frame->packet) );
+            _melo_packet_handler( ctx, &(frame->packet), crc_present );
         }
         else
         {
@@ -760,7 +3409,20 @@ static void _melo_frame_handler(const _m_frame * const frame, const bool crc_pre
     }
     else
     {
-        _melo_packet_handler( &(frame->packet) );
+        _melo_packet_handler( ctx, &(frame->packet), crc_present );
+    }
+}
+
+static void _melo_transmit_frame(MeloContext * const ctx, const _m_frame_buffer * const frame_buffer)
+{
+    if (frame_buffer->buffer.length > 0)
+    {
+        ctx->callbacks->transmit_bytes( ctx, &(frame_buffer->buffer.data[0]), frame_buffer->buffer.length );
+    }
+    else
+    {
+        /* Nothing to send - confirm right away so the state machine returns to IDLE */
+        _notify_event(ctx, MELO_EVNET_TX_CONFIRMATION);
     }
 }
 
@@ -773,7 +3435,8 @@ bool _is_parent(const _state_handle * const child, const _state_handle * const p
 {
     bool result = 0;
 
-    if ( (parent->left < child->left) && (parent->right > child->right) )
+    if ( (_STATE_ROM_READ(uint8_t, &(parent->left)) < _STATE_ROM_READ(uint8_t, &(child->left))) &&
+         (_STATE_ROM_READ(uint8_t, &(parent->right)) > _STATE_ROM_READ(uint8_t, &(child->right))) )
     {
         result = true;
     }
@@ -785,12 +3448,12 @@ bool _is_parent(const _state_handle * const child, const _state_handle * const p
     return result;
 }
 
-uint16_t _state_transition(uint16_t start_state, uint16_t dest_state)
+uint16_t _state_transition(MeloContext * const ctx, uint16_t start_state, uint16_t dest_state)
 {
     uint16_t index;
 
     /* Exit start_state */
-    (void) _table[start_state].function(_STATE_ACTION_EXIT, 0);
+    (void) _STATE_FUNCTION(start_state)(ctx, _STATE_ACTION_EXIT, 0);
 
     for (index = start_state; index > 0; index--)
     {
@@ -798,7 +3461,7 @@ uint16_t _state_transition(uint16_t start_state, uint16_t dest_state)
         {
             if (_is_parent( &(_table[dest_state]), &(_table[index]) ) == false)
             {
-                (void) _table[index].function(_STATE_ACTION_EXIT, 0);
+                (void) _STATE_FUNCTION(index)(ctx, _STATE_ACTION_EXIT, 0);
             }
             else
             {
@@ -817,7 +3480,7 @@ uint16_t _state_transition(uint16_t start_state, uint16_t dest_state)
         {
             if (_is_parent( &(_table[start_state]), &(_table[index]) ) == false)
             {
-                (void) _table[index].function(_STATE_ACTION_ENTRY, 0);
+                (void) _STATE_FUNCTION(index)(ctx, _STATE_ACTION_ENTRY, 0);
             }
             else
             {
@@ -831,28 +3494,72 @@ uint16_t _state_transition(uint16_t start_state, uint16_t dest_state)
     }
 
     /* Enter dest_state */
-    (void) _table[dest_state].function(_STATE_ACTION_ENTRY, 0);
+    (void) _STATE_FUNCTION(dest_state)(ctx, _STATE_ACTION_ENTRY, 0);
 
     return dest_state;
 }
 
+void _state_tick(MeloContext * const ctx, const uint16_t elapsed)
+{
+    ctx->sm.now += elapsed;
+}
+
+uint16_t _state_deadline(const MeloContext * const ctx)
+{
+    uint16_t result = _STATE_NO_DEADLINE;
+    uint16_t slot;
+    uint16_t index;
+    uint16_t after;
+    uint16_t elapsed;
+    const _state_handle * const current = &(_table[ctx->sm.current]);
+
+    /* Time left until the first AFTER() guard of the current state or one of its parents */
+    for (slot = 0; slot < 6; slot++)
+    {
+        index = _STATE_ROM_READ(uint16_t, &(_timer_state[slot]));
+        after = _STATE_ROM_READ(uint16_t, &(_after[slot]));
+
+        if ( (after != 0) &&
+             ( (index == ctx->sm.current) || (_is_parent(current, &(_table[index])) != false) ) )
+        {
+            elapsed = (uint16_t) (ctx->sm.now - ctx->sm.timer[slot]);
+
+            if (elapsed >= after)
+            {
+                result = 0;
+            }
+            else if ((uint16_t) (after - elapsed) < result)
+            {
+                result = (uint16_t) (after - elapsed);
+            }
+            else
+            {
+                /* Do nothing - a nearer deadline is pending */
+            }
+        }
+        else
+        {
+            /* Do nothing - no timer or not active */
+        }
+    }
+
+    return result;
+}
+
 
 
 
 /* State IDLE */
-static uint16_t _IDLE_(const uint8_t action, const uint8_t event)
+static uint16_t _IDLE_(MeloContext * const ctx, const uint8_t action, const uint8_t event)
 {
     uint16_t result = 0;
 
+    /* Events are handled by _state_dispatch */
+    (void) event;
+
     if (action == _STATE_ACTION_ENTRY)
     {
-    }
-    else if (action == _STATE_ACTION_DURING)
-    {
-        if (event == MELO_EVENT_REQUEST_RECEIVED)
-        {
-            result = _state_transition(0, 2);
-        }
+        _melo_rx_notify_pending(ctx); _melo_daq_notify_pending(ctx); _melo_segment_notify_pending(ctx);
     }
     else if (action == _STATE_ACTION_EXIT)
     {
@@ -865,22 +3572,17 @@ static uint16_t _IDLE_(const uint8_t action, const uint8_t event)
     return result;
 }
 /* State RESP_PROC */
-static uint16_t _RESP_PROC_(const uint8_t action, const uint8_t event)
+static uint16_t _RESP_PROC_(MeloContext * const ctx, const uint8_t action, const uint8_t event)
 {
     uint16_t result = 1;
 
+    /* Events are handled by _state_dispatch */
+    (void) event;
+
     if (action == _STATE_ACTION_ENTRY)
     {
-        _table[1].timer = 0;
-        _melo_frame_handler(&(recv_frame.frame), false);
-    }
-    else if (action == _STATE_ACTION_DURING)
-    {
-        _table[1].timer++;
-        if (_table[1].timer > _AFTER(500))
-        {
-            result = _state_transition(1, 0);
-        }
+        ctx->sm.timer[0] = ctx->sm.now;
+        _melo_process_frame(ctx);
     }
     else if (action == _STATE_ACTION_EXIT)
     {
@@ -893,24 +3595,16 @@ static uint16_t _RESP_PROC_(const uint8_t action, const uint8_t event)
     return result;
 }
 /* State RESP_PEND */
-static uint16_t _RESP_PEND_(const uint8_t action, const uint8_t event)
+static uint16_t _RESP_PEND_(MeloContext * const ctx, const uint8_t action, const uint8_t event)
 {
     uint16_t result = 2;
 
+    /* Events are handled by _state_dispatch */
+    (void) event;
+
     if (action == _STATE_ACTION_ENTRY)
     {
-        MeloTransmitBytes( &(wait_frame.buffer.data[0]), wait_frame.buffer.length );
-    }
-    else if (action == _STATE_ACTION_DURING)
-    {
-        (void) _table[1].function(_STATE_ACTION_DURING, event);
-        if (event == MELO_EVENT_REQUEST_RECEIVED)
-        {
-        }
-        if (event == MELO_EVNET_TX_CONFIRMATION)
-        {
-            result = _state_transition(2, 3);
-        }
+        _melo_transmit_frame(ctx, &(ctx->wait_frame));
     }
     else if (action == _STATE_ACTION_EXIT)
     {
@@ -923,24 +3617,131 @@ static uint16_t _RESP_PEND_(const uint8_t action, const uint8_t event)
     return result;
 }
 /* State TX_PEND */
-static uint16_t _TX_PEND_(const uint8_t action, const uint8_t event)
+static uint16_t _TX_PEND_(MeloContext * const ctx, const uint8_t action, const uint8_t event)
 {
     uint16_t result = 3;
 
+    /* Events are handled by _state_dispatch */
+    (void) event;
+
     if (action == _STATE_ACTION_ENTRY)
     {
-        MeloTransmitBytes( &(send_frame.buffer.data[0]), send_frame.buffer.length );
+        _melo_transmit_frame(ctx, &(ctx->send_frame));
     }
-    else if (action == _STATE_ACTION_DURING)
+    else if (action == _STATE_ACTION_EXIT)
     {
-        (void) _table[1].function(_STATE_ACTION_DURING, event);
-        if (event == MELO_EVENT_REQUEST_RECEIVED)
-        {
-        }
-        if (event == MELO_EVNET_TX_CONFIRMATION)
-        {
-            result = _state_transition(3, 0);
-        }
+    }
+    else
+    {
+        /* Error - ??? */
+    }
+
+    return result;
+}
+/* State DAQ_TX */
+static uint16_t _DAQ_TX_(MeloContext * const ctx, const uint8_t action, const uint8_t event)
+{
+    uint16_t result = 4;
+
+    /* Events are handled by _state_dispatch */
+    (void) event;
+
+    if (action == _STATE_ACTION_ENTRY)
+    {
+        ctx->sm.timer[1] = ctx->sm.now;
+        _melo_daq_transmit(ctx);
+    }
+    else if (action == _STATE_ACTION_EXIT)
+    {
+    }
+    else
+    {
+        /* Error - ??? */
+    }
+
+    return result;
+}
+/* State SEG_TX */
+static uint16_t _SEG_TX_(MeloContext * const ctx, const uint8_t action, const uint8_t event)
+{
+    uint16_t result = 5;
+
+    /* Events are handled by _state_dispatch */
+    (void) event;
+
+    if (action == _STATE_ACTION_ENTRY)
+    {
+        ctx->sm.timer[2] = ctx->sm.now;
+        _melo_segment_transmit(ctx);
+    }
+    else if (action == _STATE_ACTION_EXIT)
+    {
+    }
+    else
+    {
+        /* Error - ??? */
+    }
+
+    return result;
+}
+/* State OP_BUSY */
+static uint16_t _OP_BUSY_(MeloContext * const ctx, const uint8_t action, const uint8_t event)
+{
+    uint16_t result = 6;
+
+    /* Events are handled by _state_dispatch */
+    (void) event;
+
+    if (action == _STATE_ACTION_ENTRY)
+    {
+        ctx->sm.timer[3] = ctx->sm.now;
+        _melo_operation_notify_done(ctx);
+    }
+    else if (action == _STATE_ACTION_EXIT)
+    {
+    }
+    else
+    {
+        /* Error - ??? */
+    }
+
+    return result;
+}
+/* State OP_PEND */
+static uint16_t _OP_PEND_(MeloContext * const ctx, const uint8_t action, const uint8_t event)
+{
+    uint16_t result = 7;
+
+    /* Events are handled by _state_dispatch */
+    (void) event;
+
+    if (action == _STATE_ACTION_ENTRY)
+    {
+        ctx->sm.timer[4] = ctx->sm.now;
+        _melo_transmit_frame(ctx, &(ctx->wait_frame));
+    }
+    else if (action == _STATE_ACTION_EXIT)
+    {
+    }
+    else
+    {
+        /* Error - ??? */
+    }
+
+    return result;
+}
+/* State OP_TX */
+static uint16_t _OP_TX_(MeloContext * const ctx, const uint8_t action, const uint8_t event)
+{
+    uint16_t result = 8;
+
+    /* Events are handled by _state_dispatch */
+    (void) event;
+
+    if (action == _STATE_ACTION_ENTRY)
+    {
+        ctx->sm.timer[5] = ctx->sm.now;
+        _melo_operation_respond(ctx);
     }
     else if (action == _STATE_ACTION_EXIT)
     {
@@ -953,4 +3754,227 @@ static uint16_t _TX_PEND_(const uint8_t action, const uint8_t event)
     return result;
 }
 
+uint16_t _state_dispatch(MeloContext * const ctx, const uint8_t event)
+{
+    uint16_t result = ctx->sm.current;
+
+    switch (event)
+    {
+        case MELO_EVENT_REQUEST_RECEIVED:
+        {
+            switch (ctx->sm.current)
+            {
+                case 0:
+                {
+                    /* IDLE */
+                    if (_melo_rx_pending(ctx) != false)
+                    {
+                        result = _state_transition(ctx, ctx->sm.current, 2);
+                    }
+                    break;
+                }
+                default:
+                {
+                    /* Do nothing - no transition on this event */
+                    break;
+                }
+            }
+            break;
+        }
+        case MELO_EVNET_TX_CONFIRMATION:
+        {
+            switch (ctx->sm.current)
+            {
+                case 2:
+                {
+                    /* RESP_PEND */
+                    result = _state_transition(ctx, ctx->sm.current, 3);
+                    break;
+                }
+                case 3:
+                {
+                    /* TX_PEND */
+                    if (_melo_operation_pending(ctx) != false)
+                    {
+                        result = _state_transition(ctx, ctx->sm.current, 6);
+                    }
+                    else
+                    {
+                        result = _state_transition(ctx, ctx->sm.current, 0);
+                    }
+                    break;
+                }
+                case 4:
+                {
+                    /* DAQ_TX */
+                    result = _state_transition(ctx, ctx->sm.current, 0);
+                    break;
+                }
+                case 5:
+                {
+                    /* SEG_TX */
+                    result = _state_transition(ctx, ctx->sm.current, 0);
+                    break;
+                }
+                case 7:
+                {
+                    /* OP_PEND */
+                    result = _state_transition(ctx, ctx->sm.current, 6);
+                    break;
+                }
+                case 8:
+                {
+                    /* OP_TX */
+                    result = _state_transition(ctx, ctx->sm.current, 0);
+                    break;
+                }
+                default:
+                {
+                    /* Do nothing - no transition on this event */
+                    break;
+                }
+            }
+            break;
+        }
+        case MELO_EVENT_DAQ_TRIGGER:
+        {
+            switch (ctx->sm.current)
+            {
+                case 0:
+                {
+                    /* IDLE */
+                    if (_melo_daq_pending(ctx) != false)
+                    {
+                        result = _state_transition(ctx, ctx->sm.current, 4);
+                    }
+                    break;
+                }
+                default:
+                {
+                    /* Do nothing - no transition on this event */
+                    break;
+                }
+            }
+            break;
+        }
+        case MELO_EVENT_TIMEOUT:
+        {
+            switch (ctx->sm.current)
+            {
+                case 1:
+                case 2:
+                case 3:
+                {
+                    /* RESP_PROC */
+                    if ((uint16_t) (ctx->sm.now - ctx->sm.timer[0]) >= _AFTER(500))
+                    {
+                        result = _state_transition(ctx, ctx->sm.current, 0);
+                    }
+                    break;
+                }
+                case 4:
+                {
+                    /* DAQ_TX */
+                    if ((uint16_t) (ctx->sm.now - ctx->sm.timer[1]) >= _AFTER(500))
+                    {
+                        result = _state_transition(ctx, ctx->sm.current, 0);
+                    }
+                    break;
+                }
+                case 5:
+                {
+                    /* SEG_TX */
+                    if ((uint16_t) (ctx->sm.now - ctx->sm.timer[2]) >= _AFTER(500))
+                    {
+                        result = _state_transition(ctx, ctx->sm.current, 0);
+                    }
+                    break;
+                }
+                case 6:
+                {
+                    /* OP_BUSY */
+                    if ((uint16_t) (ctx->sm.now - ctx->sm.timer[3]) >= _AFTER(250))
+                    {
+                        result = _state_transition(ctx, ctx->sm.current, 7);
+                    }
+                    break;
+                }
+                case 7:
+                {
+                    /* OP_PEND */
+                    if ((uint16_t) (ctx->sm.now - ctx->sm.timer[4]) >= _AFTER(500))
+                    {
+                        result = _state_transition(ctx, ctx->sm.current, 6);
+                    }
+                    break;
+                }
+                case 8:
+                {
+                    /* OP_TX */
+                    if ((uint16_t) (ctx->sm.now - ctx->sm.timer[5]) >= _AFTER(500))
+                    {
+                        result = _state_transition(ctx, ctx->sm.current, 0);
+                    }
+                    break;
+                }
+                default:
+                {
+                    /* Do nothing - no transition on this event */
+                    break;
+                }
+            }
+            break;
+        }
+        case MELO_EVENT_SEGMENT:
+        {
+            switch (ctx->sm.current)
+            {
+                case 0:
+                {
+                    /* IDLE */
+                    if (_melo_segment_pending(ctx) != false)
+                    {
+                        result = _state_transition(ctx, ctx->sm.current, 5);
+                    }
+                    break;
+                }
+                default:
+                {
+                    /* Do nothing - no transition on this event */
+                    break;
+                }
+            }
+            break;
+        }
+        case MELO_EVENT_OPERATION_DONE:
+        {
+            switch (ctx->sm.current)
+            {
+                case 6:
+                {
+                    /* OP_BUSY */
+                    if (_melo_operation_done(ctx) != false)
+                    {
+                        result = _state_transition(ctx, ctx->sm.current, 8);
+                    }
+                    break;
+                }
+                default:
+                {
+                    /* Do nothing - no transition on this event */
+                    break;
+                }
+            }
+            break;
+        }
+        default:
+        {
+            /* Do nothing - no transition on this event */
+            break;
+        }
+    }
+
+    return result;
+}
+
 /*[[[end]]]*/
@@ -74,6 +74,87 @@ typedef struct
     uint8_t  size;
 } MeloList;
 
+typedef struct _m_context MeloContext;
+
+typedef struct
+{
+    uint8_t  subfunction;
+    uint8_t  byte_order;
+    MeloList data;
+} MeloMessage;
+
+/* Service handler, fills response->data (up to response->data.size bytes) and returns false for a negative response */
+typedef bool (*MeloService)( MeloContext * const ctx, const MeloMessage * const request, MeloMessage * const response );
+
+typedef struct
+{
+    uint8_t * (*create_pointer)  ( MeloContext * const ctx, const uint32_t address );
+    void      (*transmit_bytes)  ( MeloContext * const ctx, const uint8_t * const bytes, const uint8_t length );
+#ifdef MELO_CFG_MODE_MASTER
+    void      (*request_bytes)   ( MeloContext * const ctx, const uint8_t num );
+    void      (*receive_response)( MeloContext * const ctx, const uint8_t tag, const uint8_t service, const uint8_t subfunction, const uint8_t * const bytes, const uint8_t length, bool postive, const uint8_t byte_order );
+    void      (*receive_daq)     ( MeloContext * const ctx, const uint8_t list, const uint8_t counter, const uint8_t * const bytes, const uint8_t length );
+#endif
+#ifdef MELO_CFG_FLASH
+    bool      (*flash_erase)     ( MeloContext * const ctx, const uint32_t address, const uint32_t length );
+    bool      (*flash_write)     ( MeloContext * const ctx, const uint32_t address, const uint8_t * const bytes, const uint8_t length );
+#endif
+} MeloCallbacks;
+
+/* Returned by MeloBackground when no timeout is pending */
+#define MELO_NO_DEADLINE               0xFFFFu
+
+/* Tag reported for responses to untagged requests */
+#define MELO_TAG_NONE                  0xFFu
+
+/* Services */
+#define MELO_SERVICE_READ_WRITE        0u
+#define MELO_SERVICE_GATHER_READ       1u
+#define MELO_SERVICE_DAQ               2u
+#define MELO_SERVICE_TRANSFER          3u
+#define MELO_SERVICE_FLASH             4u
+#define MELO_SERVICE_CHECKSUM          5u
+#define MELO_SERVICE_BLOCK_HASH        6u
+#define MELO_SERVICE_MEMORY            7u
+#define MELO_SERVICE_WAIT              8u
+
+/* DAQ subfunctions */
+#define MELO_DAQ_CLEAR                 0u  /* Stop and clear every list                                          */
+#define MELO_DAQ_SET_LIST              1u  /* list | event channel | prescaler | { address (4) | size (1) } * n */
+#define MELO_DAQ_START                 2u  /* list                                                               */
+#define MELO_DAQ_STOP                  3u  /* list                                                               */
+#define MELO_DAQ_SAMPLE                4u  /* Slave to master: list | counter | values                           */
+
+/* Transfer subfunctions, addresses and lengths are in the frame's byte order */
+#define MELO_TRANSFER_WRITE            0u  /* address (4) | length (2) | data                                    */
+#define MELO_TRANSFER_READ             1u  /* address (4) | length (2), answered with length (2) | data          */
+#define MELO_TRANSFER_CONSECUTIVE      2u  /* sequence (1) | data                                                */
+#define MELO_TRANSFER_FLOW_CONTROL     3u  /* flow status (1) | block size (1) | separation time in ms (1)       */
+
+/* Transfer flow status */
+#define MELO_FLOW_CONTINUE             0u
+#define MELO_FLOW_ABORT                1u
+
+/* Flash subfunctions */
+#define MELO_FLASH_ERASE               0u  /* address (4) | length (4)                                           */
+#define MELO_FLASH_PROGRAM             1u  /* address (4) | data                                                 */
+#define MELO_FLASH_VERIFY              2u  /* address (4) | data, a mismatch is answered negatively with its offset */
+
+/* Memory subfunctions, run on the slave; addresses, lengths and values are in the frame's byte order */
+#define MELO_MEMORY_MODIFY             0u  /* address (4) | width (1) | mask | value, only the bits in mask are written */
+#define MELO_MEMORY_FILL               1u  /* address (4) | length (4) | pattern                                    */
+#define MELO_MEMORY_COPY               2u  /* destination (4) | source (4) | length (4), the ranges may overlap     */
+#define MELO_MEMORY_SEARCH             3u  /* address (4) | length (4) | pattern, answered with n (1) | address (4) * n */
+
+/* Wait subfunctions, the comparison of (memory & mask) with value, unsigned; the request is
+   address (4) | width (1) | mask | value | timeout in ms (2), in the frame's byte order */
+#define MELO_WAIT_EQUAL                0u
+#define MELO_WAIT_NOT_EQUAL            1u
+#define MELO_WAIT_LESS                 2u
+#define MELO_WAIT_LESS_EQUAL           3u
+#define MELO_WAIT_GREATER              4u
+#define MELO_WAIT_GREATER_EQUAL        5u
+
 #define MELO_LITTLE_ENDIAN             0u
 #define MELO_BIG_ENDIAN                1u
 
@@ -89,6 +170,19 @@ typedef struct
     #endif
 #endif
 
+/* Detect the processor byte order from the compiler when it is not configured */
+#ifndef MELO_CFG_PE_ENDIANESS
+    #if defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+        #define MELO_CFG_PE_ENDIANESS  MELO_LITTLE_ENDIAN
+    #elif defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+        #define MELO_CFG_PE_ENDIANESS  MELO_BIG_ENDIAN
+    #elif defined(__LITTLE_ENDIAN__) || defined(__AVR__) || defined(_M_IX86) || defined(_M_X64) || defined(_M_ARM) || defined(_M_ARM64)
+        #define MELO_CFG_PE_ENDIANESS  MELO_LITTLE_ENDIAN
+    #elif defined(__BIG_ENDIAN__)
+        #define MELO_CFG_PE_ENDIANESS  MELO_BIG_ENDIAN
+    #endif
+#endif
+
 #ifndef MELO_CFG_PE_ENDIANESS
     #define MELO_CFG_PE_ENDIANESS MeloGetEndianess()
 #else
@@ -98,11 +192,39 @@ typedef struct
 /******************************************************************************
 *                       Exported Function Prototypes                          *
 ******************************************************************************/
-void    MeloBackground(void);
+MeloContext * MeloInitCtx( const MeloCallbacks * const callbacks, void * const user_data );
+void    MeloFreeCtx( MeloContext * const ctx );
+uint16_t MeloBackgroundCtx( MeloContext * const ctx );
+void    MeloTickCtx( MeloContext * const ctx, const uint16_t elapsed_ms );
+void    MeloTransmitCompleteCtx( MeloContext * const ctx );
+void    MeloReceiveByteCtx( MeloContext * const ctx, const uint8_t byte );
+void    MeloReceiveBytesCtx( MeloContext * const ctx, const uint8_t * const bytes, const uint8_t num );
+void *  MeloGetUserData( const MeloContext * const ctx );
+uint8_t MeloGetEventOverflows( const MeloContext * const ctx );
+bool    MeloRegisterService( const uint8_t service, const MeloService handler );
+
+#ifdef MELO_CFG_DAQ
+void    MeloDaqTriggerCtx( MeloContext * const ctx, const uint8_t event_channel );
+#endif
+
+#ifdef MELO_CFG_FLASH
+void    MeloFlashCompleteCtx( MeloContext * const ctx, const bool success );
+#endif
+
+#ifdef MELO_CFG_DEFAULT_CONTEXT
+uint16_t MeloBackground(void);
+void    MeloTick( const uint16_t elapsed_ms );
 void    MeloInit(void);
 void    MeloTransmitComplete(void);
 void    MeloReceiveByte( const uint8_t byte );
 void    MeloReceiveBytes( const uint8_t * const bytes, const uint8_t num );
+#ifdef MELO_CFG_DAQ
+void    MeloDaqTrigger( const uint8_t event_channel );
+#endif
+#ifdef MELO_CFG_FLASH
+void    MeloFlashComplete( const bool success );
+#endif
+#endif
 
 #ifndef MELO_COMPILE_TIME_ENDIAN
 uint8_t MeloGetEndianess(void);
@@ -110,18 +232,33 @@ uint8_t MeloGetEndianess(void);
 
 #ifdef MELO_CFG_MODE_MASTER
 uint8_t MeloServiceRequestBuilder(uint8_t * buffer, const uint8_t service, const uint8_t subfunction, const MeloList * const request_data, const bool use_crc );
+uint8_t MeloTaggedRequestBuilder(MeloContext * const ctx, uint8_t * buffer, const uint8_t service, const uint8_t subfunction, const MeloList * const request_data, const bool use_crc, uint8_t * const tag );
+void    MeloCancelRequest(MeloContext * const ctx, const uint8_t tag );
+#ifdef MELO_CFG_DIRECT_RESPONSE
+void    MeloSetDirectResponse( MeloContext * const ctx, const bool enable );
+#endif
+#ifdef MELO_CFG_BLOCK_HASH
+uint8_t MeloBlockHashDiff( const uint8_t * const mirror, const uint32_t length, const uint16_t block_size, const uint8_t * const hashes, const uint8_t num_hashes, uint8_t * const changed );
+#endif
 #endif
 
 /******************************************************************************
 *                       Application Function Prototypes                       *
 ******************************************************************************/
+#ifdef MELO_CFG_DEFAULT_CONTEXT
 uint8_t * MeloCreatePointer( const uint32_t address );
 void      MeloTransmitBytes( const uint8_t * const bytes, const uint8_t length );
 
+#ifdef MELO_CFG_FLASH
+bool      MeloFlashErase( const uint32_t address, const uint32_t length );
+bool      MeloFlashWrite( const uint32_t address, const uint8_t * const bytes, const uint8_t length );
+#endif
+
 #ifdef MELO_CFG_MODE_MASTER
 void      MeloRequestBytes( const uint8_t num );
 void      MeloReceiveResponse( const uint8_t service, const uint8_t subfunction, const uint8_t * const bytes, const uint8_t length, bool postive );
 #endif
+#endif
 
 #ifdef __cplusplus
 } /* extern "C" */
@@ -28,14 +28,94 @@ extern "C" {
 #include <stdint.h>
 
 #define MELO_CFG_MAX_DATA_LENGTH       100
-#define MELO_CFG_MAX_STACK_SIZE        5
+#define MELO_CFG_EVENT_QUEUE_SIZE      8
+#define MELO_CFG_RX_FRAME_COUNT        2
+/* Service IDs the application can register handlers for with MeloRegisterService (0 to this - 1). Melo's own
+   services are kept in a constant table and need no slot. */
+#define MELO_CFG_NUM_SERVICES          16
+#ifndef MELO_CFG_MAX_CONTEXTS
+#define MELO_CFG_MAX_CONTEXTS          1
+#endif
+
+/* Provide MeloInit, MeloBackground, ... bound to the application's MeloCreatePointer, MeloTransmitBytes, ...
+   Builds that only use MeloInitCtx (e.g. the C++ master client) define MELO_CFG_NO_DEFAULT_CONTEXT instead. */
+#ifndef MELO_CFG_NO_DEFAULT_CONTEXT
+#define MELO_CFG_DEFAULT_CONTEXT
+#endif
 
 #define MELO_CFG_MODE_SLAVE
 /* #define MELO_CFG_MODE_MASTER */
 
+/* Master only: number of tagged requests that may be in flight at once */
+#define MELO_CFG_MAX_OUTSTANDING       4
+
+/* Frame the requests (master) or DAQ samples (slave) sent by this side with COBS instead of escape bytes. Responses
+   always use the framing of their request. */
+/* #define MELO_CFG_COBS */
+
+/* Slave only: DAQ lists streamed on MeloDaqTrigger, and the number of variables per list
+#define MELO_CFG_DAQ
+#define MELO_CFG_DAQ_LISTS             2
+#define MELO_CFG_DAQ_MAX_ENTRIES       16
+*/
+
+/* Slave only: segmented transfers (service 3), the consecutive frames accepted between two flow control frames
+   (0 for no limit), and the separation time in ms the master must leave between them
+#define MELO_CFG_SEGMENT
+#define MELO_CFG_SEGMENT_BLOCK_SIZE    8
+#define MELO_CFG_SEGMENT_ST_MIN        0
+*/
+
+/* Slave only: flash/EEPROM programming (service 4) through the application's MeloFlashErase and MeloFlashWrite */
+/* #define MELO_CFG_FLASH */
+
+/* Slave only: CRC-32 of a memory region (service 5) and per-block CRC-32s of a range (service 6), computed this
+   many bytes per MeloBackground call. The master side of service 6 only needs MELO_CFG_BLOCK_HASH.
+#define MELO_CFG_CHECKSUM
+#define MELO_CFG_BLOCK_HASH
+#define MELO_CFG_CHECKSUM_CHUNK        256
+*/
+
+/* Slave only: memory operations run on the slave (service 7), the bytes filled, copied or searched per MeloBackground
+   call and the longest fill or search pattern. Masked writes are atomic once MELO_CFG_ENTER_CRITICAL is defined.
+#define MELO_CFG_MEMORY_OPS
+#define MELO_CFG_MEMORY_CHUNK          256
+#define MELO_CFG_MEMORY_PATTERN        8
+*/
+
+/* Slave only: answer once memory matches a condition or a timeout passes (service 8), checked on every MeloBackground call */
+/* #define MELO_CFG_WAIT */
+
+/* Answer without the pending frame on links where the slave can transmit on its own (e.g. UART). The master asks
+   for it per context with MeloSetDirectResponse, a slave built without it keeps sending pending frames. */
+/* #define MELO_CFG_DIRECT_RESPONSE */
+
 /*#define MELO_CFG_BIG_ENDIAN */
 /* #define MELO_CFG_LITTLE_ENDIAN */
 
+/* CRC-8 by default, CRC-16 when enabled */
+/* #define MELO_CFG_CRC_16 */
+/* Use a 16 entry table instead of a 256 entry table (less flash, slower) */
+/* #define MELO_CFG_CRC_NIBBLE_TABLE */
+/* Use the application's MeloCrcHwUpdate (e.g. a hardware CRC unit) */
+/* #define MELO_CFG_CRC_HW */
+
+/* Required when Melo functions are called from an interrupt, e.g. MeloReceiveByte from the UART RX interrupt.
+   MeloBackground queues events of its own, so every event is then queued with MELO_CFG_ENTER_CRITICAL held.
+   The critical section defaults to cli()/sei() on AVR and must be defined on other targets.
+#define MELO_CFG_INTERRUPTS
+#define MELO_CFG_ENTER_CRITICAL()      cli()
+#define MELO_CFG_EXIT_CRITICAL()       sei()
+*/
+
+/* Placement of constant tables (CRC and state machine), e.g. for AVR:
+#include <avr/pgmspace.h>
+#define MELO_CFG_ROM                   PROGMEM
+#define MELO_CFG_ROM_READ_BYTE(p)      pgm_read_byte(p)
+#define MELO_CFG_ROM_READ_WORD(p)      pgm_read_word(p)
+#define MELO_CFG_ROM_READ_DWORD(p)     pgm_read_dword(p)
+*/
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2015 David Sunshine, <http://sunshin.es>
+ *
+ * This file is part of melo.
+ *
+ * melo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * melo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with melo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __MELO_CRC_H_
+#define __MELO_CRC_H_
+
+/******************************************************************************
+*                                   Includes                                  *
+******************************************************************************/
+#include "melo.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/******************************************************************************
+*                             Exported Data Types                             *
+******************************************************************************/
+#ifdef MELO_CFG_CRC_16
+    /* CRC-16/CCITT-FALSE: poly 0x1021, init 0xFFFF */
+    typedef uint16_t MeloCrc;
+    #define MELO_CRC_SIZE              2u
+    #define MELO_CRC_INIT              ( (MeloCrc) 0xFFFFu )
+#else
+    /* CRC-8/SMBUS: poly 0x07, init 0x00 */
+    typedef uint8_t  MeloCrc;
+    #define MELO_CRC_SIZE              1u
+    #define MELO_CRC_INIT              ( (MeloCrc) 0x00u   )
+#endif
+
+/* Running the CRC over the data followed by its own CRC (MSB first) yields zero */
+#define MELO_CRC_RESIDUE               ( (MeloCrc) 0u )
+
+/* CRC-32 (IEEE 802.3): reflected poly 0xEDB88320, init and final XOR 0xFFFFFFFF, for memory regions */
+#define MELO_CRC32_INIT                0xFFFFFFFFul
+#define MELO_CRC32_XOROUT              0xFFFFFFFFul
+
+#if defined(MELO_CRC_ALL_VARIANTS)
+    /* Host benchmarks build every software variant */
+    #define MELO_CRC_8_TABLE256_ENABLED
+    #define MELO_CRC_8_TABLE16_ENABLED
+    #define MELO_CRC_16_TABLE256_ENABLED
+    #define MELO_CRC_16_TABLE16_ENABLED
+    #define MELO_CRC_32_TABLE16_ENABLED
+#endif
+
+#if ( defined(MELO_CFG_CHECKSUM) || defined(MELO_CFG_BLOCK_HASH) ) && !defined(MELO_CRC_32_TABLE16_ENABLED)
+    #define MELO_CRC_32_TABLE16_ENABLED
+#endif
+
+#if defined(MELO_CFG_CRC_HW)
+    #define MELO_CRC_UPDATE(c,b)       MeloCrcHwUpdate((c), (b))
+#elif defined(MELO_CFG_CRC_16) && defined(MELO_CFG_CRC_NIBBLE_TABLE)
+    #define MELO_CRC_16_TABLE16_ENABLED
+    #define MELO_CRC_UPDATE(c,b)       MeloCrc16Table16Update((c), (b))
+#elif defined(MELO_CFG_CRC_16)
+    #define MELO_CRC_16_TABLE256_ENABLED
+    #define MELO_CRC_UPDATE(c,b)       MeloCrc16Table256Update((c), (b))
+#elif defined(MELO_CFG_CRC_NIBBLE_TABLE)
+    #define MELO_CRC_8_TABLE16_ENABLED
+    #define MELO_CRC_UPDATE(c,b)       MeloCrc8Table16Update((c), (b))
+#else
+    #define MELO_CRC_8_TABLE256_ENABLED
+    #define MELO_CRC_UPDATE(c,b)       MeloCrc8Table256Update((c), (b))
+#endif
+
+/******************************************************************************
+*                       Exported Function Prototypes                          *
+******************************************************************************/
+#ifdef MELO_CRC_8_TABLE256_ENABLED
+uint8_t  MeloCrc8Table256Update( const uint8_t crc, const uint8_t byte );
+#endif
+
+#ifdef MELO_CRC_8_TABLE16_ENABLED
+uint8_t  MeloCrc8Table16Update( const uint8_t crc, const uint8_t byte );
+#endif
+
+#ifdef MELO_CRC_16_TABLE256_ENABLED
+uint16_t MeloCrc16Table256Update( const uint16_t crc, const uint8_t byte );
+#endif
+
+#ifdef MELO_CRC_16_TABLE16_ENABLED
+uint16_t MeloCrc16Table16Update( const uint16_t crc, const uint8_t byte );
+#endif
+
+#ifdef MELO_CRC_32_TABLE16_ENABLED
+uint32_t MeloCrc32Table16Update( const uint32_t crc, const uint8_t byte );
+#endif
+
+/******************************************************************************
+*                       Application Function Prototypes                       *
+******************************************************************************/
+#ifdef MELO_CFG_CRC_HW
+/* Must implement the same polynomial and bit order as the selected software CRC */
+MeloCrc   MeloCrcHwUpdate( const MeloCrc crc, const uint8_t byte );
+#endif
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif
@@ -24,6 +24,7 @@
 *                                   Includes                                  *
 ******************************************************************************/
 #include "melo.h"
+#include "melo_crc.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -49,14 +50,133 @@ typedef struct
 	_m_command command;
     MeloList   data;
     uint8_t    byte_order;
+    bool       cobs;
+    uint8_t    ext_flags;
+    uint8_t    tag;
+    uint8_t    service;
 } _m_packet;
 
-typedef bool (*_m_service)(const _m_packet * const request, _m_packet * const response);
+/*
+    FIFO of the events for MeloBackground. The indices run freely and are only
+    masked on access, so all slots are usable. Events are queued by the
+    application, possibly from interrupts, and by MeloBackground itself, so
+    _notify_event updates head with MELO_CFG_ENTER_CRITICAL held. tail is only
+    written by the consumer (_get_event).
+*/
+typedef struct
+{
+    volatile uint8_t data[MELO_CFG_EVENT_QUEUE_SIZE];
+    volatile uint8_t head;
+    volatile uint8_t tail;
+    volatile uint8_t overflow;
+} _m_event_queue;
+
+#ifdef MELO_CFG_MODE_MASTER
+typedef struct
+{
+    bool    used;
+    uint8_t tag;
+} _m_outstanding;
+#endif
+
+#ifdef MELO_CFG_DAQ
+typedef struct
+{
+    const uint8_t * address;
+    uint8_t         size;
+} _m_daq_entry;
+
+typedef struct
+{
+    _m_daq_entry entries[MELO_CFG_DAQ_MAX_ENTRIES];
+    uint8_t      count;
+    uint8_t      channel;
+    uint8_t      prescaler;
+    uint8_t      divider;
+    bool         running;
+    uint8_t      sample_length;
+    uint8_t      sample[MELO_CFG_MAX_DATA_LENGTH];
+} _m_daq_list;
+#endif
+
+#ifdef MELO_CFG_SEGMENT
+typedef struct
+{
+    uint8_t * address;
+    uint16_t  remaining;
+    uint16_t  gap;
+    uint8_t   mode;
+    uint8_t   sequence;
+    uint8_t   block;
+    uint8_t   st_min;
+    bool      cobs;
+    bool      crc_present;
+} _m_segment;
+#endif
+
+/* Services that answer once a longer operation completes */
+#if defined(MELO_CFG_FLASH) || defined(MELO_CFG_CHECKSUM) || defined(MELO_CFG_BLOCK_HASH) || defined(MELO_CFG_MEMORY_OPS) || defined(MELO_CFG_WAIT)
+    #define MELO_OPERATION_ENABLED
+#endif
+
+/* A request answered once a longer operation completes, step runs it from MeloBackground when set */
+typedef void (*_m_operation_step)(MeloContext * const ctx);
+
+typedef struct
+{
+    _m_operation_step step;
+    bool              pending;
+    volatile bool     done;
+    volatile bool     success;
+} _m_operation;
+
+#if defined(MELO_CFG_CHECKSUM) || defined(MELO_CFG_BLOCK_HASH)
+/* A CRC-32 per block of the region, the checksum service hashes the whole region as one block */
+typedef struct
+{
+    const uint8_t * address;
+    uint32_t        remaining;
+    uint32_t        block;
+    uint32_t        block_remaining;
+    uint32_t        crc;
+    uint8_t         byte_order;
+} _m_checksum;
+#endif
+
+#ifdef MELO_CFG_MEMORY_OPS
+/* A fill, copy or search in progress, source is the position searched */
+typedef struct
+{
+    uint8_t       * destination;
+    const uint8_t * source;
+    uint32_t        address;
+    uint32_t        remaining;
+    uint8_t         pattern[MELO_CFG_MEMORY_PATTERN];
+    uint8_t         pattern_length;
+    uint8_t         phase;
+    uint8_t         byte_order;
+    bool            backward;
+} _m_memory;
+#endif
+
+#ifdef MELO_CFG_WAIT
+/* A condition polled by MeloBackground, timeout counts down with MeloTick */
+typedef struct
+{
+    const uint8_t * address;
+    uint32_t        mask;
+    uint32_t        value;
+    uint16_t        timeout;
+    uint8_t         width;
+    uint8_t         compare;
+    uint8_t         byte_order;
+} _m_wait;
+#endif
 
 typedef struct
 {
 	_m_packet packet;
-    uint8_t   crc;
+    MeloCrc   crc;
 } _m_frame;
 
 typedef struct
@@ -64,7 +184,10 @@ typedef struct
 	_m_frame frame;
     MeloList buffer;
     uint8_t  escape_buffer;
+    bool     cobs_zero;
     bool     crc_present;
+    bool     ext_present;
+    MeloCrc  crc;
 } _m_frame_buffer;
 
 #define MELO_CMD_REQUEST_RESPONSE      0u
@@ -72,20 +195,38 @@ typedef struct
 #define MELO_CMD_NEGATIVE_RESPONSE     2u
 #define MELO_CMD_PENDING_RESPONSE      3u
 
+/* How the request being processed is answered; a deferred response is announced by a pending frame of length 0 */
+#define MELO_REPLY_NOW                 0u
+#define MELO_REPLY_NONE                1u
+#define MELO_REPLY_DEFERRED            2u
+
 #define MELO_PACKET_SIZE               2u
-#define MELO_FRAME_SIZE                3u
+#define MELO_FRAME_SIZE                (2u + MELO_CRC_SIZE)
 #define MELO_WAIT_DATA_SIZE            1u
-#define MELO_MAX_PACKET_SIZE           (MELO_CFG_MAX_DATA_LENGTH + MELO_PACKET_SIZE)
-#define MELO_MAX_FRAME_SIZE            (MELO_MAX_PACKET_SIZE     + MELO_FRAME_SIZE)
-#define MELO_MAX_WAIT_FRAME_SIZE       (MELO_PACKET_SIZE + MELO_FRAME_SIZE + MELO_WAIT_DATA_SIZE)
+#define MELO_ESCAPE_SIZE(n)            ( ((n) + MELO_CRC_SIZE + (NUM_ESCAPE_BYTES - 1u)) / NUM_ESCAPE_BYTES )
+#define MELO_MAX_PACKET_SIZE           (MELO_CFG_MAX_DATA_LENGTH + MELO_PACKET_SIZE + MELO_MAX_EXT_SIZE)
+#define MELO_MAX_FRAME_SIZE            (MELO_MAX_PACKET_SIZE + MELO_FRAME_SIZE + MELO_ESCAPE_SIZE(MELO_CFG_MAX_DATA_LENGTH + MELO_MAX_EXT_SIZE))
+#define MELO_MAX_WAIT_FRAME_SIZE       (MELO_PACKET_SIZE + MELO_MAX_EXT_SIZE + MELO_FRAME_SIZE + MELO_WAIT_DATA_SIZE + MELO_ESCAPE_SIZE(MELO_WAIT_DATA_SIZE + MELO_MAX_EXT_SIZE))
+
+/*
+    Extended header, present when FRAME_EXT_BIT_POS is set in the HEAD/TAIL. It
+    follows the command byte: a flags byte, then each field the flags announce,
+    in bit order.
+*/
+#define MELO_EXT_TAG_BIT_POS           0u
+#define MELO_EXT_SERVICE_BIT_POS       1u
+#define MELO_EXT_DIRECT_BIT_POS        2u  /* Request only, no field: answer without a pending frame */
+#define MELO_EXT_FLAGS_SIZE            1u
+#define MELO_EXT_TAG_SIZE              1u
+#define MELO_EXT_SERVICE_SIZE          1u
+#define MELO_MAX_EXT_SIZE              (MELO_EXT_FLAGS_SIZE + MELO_EXT_TAG_SIZE + MELO_EXT_SERVICE_SIZE)
+
+/* Service IDs that fit in the command byte, larger IDs are sent in the extended header */
+#define MELO_CMD_MAX_SERVICE           3u
 
 #define MELO_CMD_HEAD                  0u
 #define MELO_CMD_TAIL                  1u
 
-#define MELO_EVENT_IDLE                0u
-#define MELO_EVENT_REQUEST_RECEIVED    1u
-#define MELO_EVNET_TX_CONFIRMATION     2u
-
 #define BIT_MASK(n)                    ( ((uint8_t) 1u) << ((uint8_t) (n)) )
 #define IS_BIT_SET(b,p)                ( ( ((b) & BIT_MASK((p))) != 0 ) ? true : false )
 #define IS_BIT_CLEAR(b,p)              ( ( ((b) & BIT_MASK((p))) == 0 ) ? true : false )
@@ -97,6 +238,8 @@ typedef struct
 #define FRAME_RESERVED_BIT_POS         5u
 #define FRAME_CRC_BIT_POS              4u
 #define FRAME_MARKER_BIT_POS           3u
+#define FRAME_EXT_BIT_POS              2u
+#define FRAME_COBS_BIT_POS             1u
 
 #define RESERVED_BIT_MASK              ( BIT_MASK(FRAME_RESERVED_BIT_POS)           )
 #define RESERVED_LOW_MASK              ( RESERVED_BIT_MASK - 1u                     )
@@ -108,12 +251,29 @@ typedef struct
 #define IS_FRAME_TAIL(b)               (  IS_BIT_CLEAR((b), FRAME_MARKER_BIT_POS)   )
 #define IS_FRAME_CRC_PRESENT(b)        (  IS_BIT_SET((b),   FRAME_CRC_BIT_POS)      )
 #define IS_FRAME_ESCAPED(b)            (  IS_BIT_SET((b),   FRAME_ESCAPE_BIT_POS)   )
+#define IS_FRAME_EXT_PRESENT(b)        (  IS_BIT_SET((b),   FRAME_EXT_BIT_POS)      )
+#define IS_FRAME_COBS(b)               (  IS_BIT_SET((b),   FRAME_COBS_BIT_POS)     )
 #define GET_FRAME_ENDIANNESS(b)        ( (IS_BIT_SET((b),   FRAME_ENDIAN_BIT_POS) != false) ?  MELO_BIG_ENDIAN : MELO_LITTLE_ENDIAN  )
 
 #define NUM_ESCAPE_BYTES               5u
 #define ESCAPE_BYTE_MASK               ( BIT_MASK(NUM_ESCAPE_BYTES) - 1u)
 #define ESCAPE_BYTE                    ( BIT_MASK(FRAME_ESCAPE_BIT_POS) | BIT_MASK(FRAME_RESERVED_BIT_POS) )
 
+/*
+    COBS framing, announced by FRAME_COBS_BIT_POS in the HEAD: the HEAD is followed
+    by the frame with every zero byte replaced by the distance to the next one, and
+    a delimiter instead of the TAIL. In the escaped framing each escape byte covers
+    NUM_ESCAPE_BYTES data bytes, which is never less than COBS needs.
+*/
+#define MELO_COBS_DELIMITER            0x00u
+#define MELO_COBS_MAX_CODE             0xFFu
+
+#ifdef MELO_CFG_COBS
+    #define MELO_TX_COBS               true
+#else
+    #define MELO_TX_COBS               false
+#endif
+
 #define RX_RECEIVED                    0u
 #define TX_CONFIRMATION                1u
 #define TX_REQUEST                     2u
@@ -122,10 +282,140 @@ typedef struct
 
 #define MELO_WRITE_BY_ADDR_MASK        0x04
 #define MELO_RW_SIZE_REQ_MASK          0x03
+#define MELO_RW_SIZE_REQ_BLOCK         0x03
 #define MELO_RW_SIZE_OF_BYTE           1u
 #define MELO_RW_SIZE_OF_WORD           2u
 #define MELO_RW_SIZE_OF_DWORD          4u
+#define MELO_RW_BLOCK_HEADER_SIZE      (MELO_SIZE_OF_MEM_ADDR + 1u)
+#define MELO_RW_BLOCK_WIDTH_SIZE       1u
 #define MELO_SIZE_OF_MEM_ADDR          4u
+#define MELO_GATHER_ENTRY_SIZE         (MELO_SIZE_OF_MEM_ADDR + 1u)
+#define MELO_DAQ_LIST_HEADER_SIZE      3u
+#define MELO_DAQ_SAMPLE_HEADER_SIZE    2u
+#define MELO_SEGMENT_LENGTH_SIZE       2u
+#define MELO_SEGMENT_FIRST_HEADER_SIZE (MELO_SIZE_OF_MEM_ADDR + MELO_SEGMENT_LENGTH_SIZE)
+#define MELO_SEGMENT_SEQUENCE_SIZE     1u
+#define MELO_SEGMENT_SEQUENCE_MASK     0x0Fu
+#define MELO_SEGMENT_FLOW_SIZE         3u
+#define MELO_FLASH_ERASE_SIZE          (MELO_SIZE_OF_MEM_ADDR + 4u)
+#define MELO_CHECKSUM_REQUEST_SIZE     (MELO_SIZE_OF_MEM_ADDR + 4u)
+#define MELO_CHECKSUM_SIZE             4u
+#define MELO_BLOCK_HASH_REQUEST_SIZE   (MELO_SIZE_OF_MEM_ADDR + 4u + 2u)
+#define MELO_MEMORY_MODIFY_HEADER_SIZE (MELO_SIZE_OF_MEM_ADDR + 1u)
+#define MELO_MEMORY_RANGE_SIZE         (MELO_SIZE_OF_MEM_ADDR + 4u)
+#define MELO_MEMORY_COPY_SIZE          (MELO_SIZE_OF_MEM_ADDR + MELO_SIZE_OF_MEM_ADDR + 4u)
+#define MELO_MEMORY_MATCH_SIZE         4u
+#define MELO_WAIT_HEADER_SIZE          (MELO_SIZE_OF_MEM_ADDR + 1u)
+#define MELO_WAIT_TIMEOUT_SIZE         2u
+
+#define MELO_SEGMENT_IDLE              0u
+#define MELO_SEGMENT_WRITE             1u
+#define MELO_SEGMENT_READ_WAIT         2u
+#define MELO_SEGMENT_READ              3u
+
+/* Services 0 to MELO_SERVICE_WAIT are provided by Melo */
+#define MELO_BUILTIN_SERVICES          ( MELO_SERVICE_WAIT + 1u )
+
+#define MELO_EVENT_QUEUE_MASK          ( (uint8_t) (MELO_CFG_EVENT_QUEUE_SIZE - 1u) )
+
+#if (MELO_CFG_NUM_SERVICES < 1) || (MELO_CFG_NUM_SERVICES > 256)
+    #error "MELO_CFG_NUM_SERVICES must be between 1 and 256!"
+#endif
+
+#if (MELO_CFG_MAX_CONTEXTS < 1) || (MELO_CFG_MAX_CONTEXTS > 65535)
+    #error "MELO_CFG_MAX_CONTEXTS must be between 1 and 65535!"
+#endif
+
+#if defined(MELO_CFG_SEGMENT) && (MELO_CFG_MAX_DATA_LENGTH <= MELO_SEGMENT_FIRST_HEADER_SIZE)
+    #error "MELO_CFG_SEGMENT requires a longer MELO_CFG_MAX_DATA_LENGTH!"
+#endif
+
+#if defined(MELO_CFG_MEMORY_OPS) && ( (MELO_CFG_MEMORY_PATTERN < 1) || (MELO_CFG_MEMORY_PATTERN > (MELO_CFG_MAX_DATA_LENGTH - MELO_MEMORY_RANGE_SIZE)) )
+    #error "MELO_CFG_MEMORY_PATTERN must be at least 1 and fit in a request!"
+#endif
+
+#if defined(MELO_CFG_DAQ) && ( (MELO_CFG_DAQ_LISTS < 1) || (MELO_CFG_DAQ_LISTS > 8) )
+    #error "MELO_CFG_DAQ_LISTS must be between 1 and 8!"
+#endif
+
+#if ( (MELO_CFG_EVENT_QUEUE_SIZE & (MELO_CFG_EVENT_QUEUE_SIZE - 1u)) != 0 ) || (MELO_CFG_EVENT_QUEUE_SIZE > 128)
+    #error "MELO_CFG_EVENT_QUEUE_SIZE must be a power of two no larger than 128!"
+#endif
+
+#define MELO_RX_FRAME_MASK             ( (uint8_t) (MELO_CFG_RX_FRAME_COUNT - 1u) )
+
+#if ( (MELO_CFG_RX_FRAME_COUNT & (MELO_CFG_RX_FRAME_COUNT - 1u)) != 0 ) || (MELO_CFG_RX_FRAME_COUNT > 128)
+    #error "MELO_CFG_RX_FRAME_COUNT must be a power of two no larger than 128!"
+#endif
+
+#ifndef MELO_INLINE
+  #if defined(__GNUC__)
+    #define MELO_INLINE                __inline__
+  #elif defined(_MSC_VER)
+    #define MELO_INLINE                __inline
+  #elif defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 199901L)
+    #define MELO_INLINE                inline
+  #else
+    #define MELO_INLINE
+  #endif
+#endif
+
+#if defined(__GNUC__) && ( (__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 8)) )
+    #define MELO_BSWAP16(x)            __builtin_bswap16(x)
+    #define MELO_BSWAP32(x)            __builtin_bswap32(x)
+#elif defined(_MSC_VER)
+    #include <stdlib.h>
+    #define MELO_BSWAP16(x)            _byteswap_ushort(x)
+    #define MELO_BSWAP32(x)            _byteswap_ulong(x)
+#else
+    #define MELO_BSWAP16(x)            ( (uint16_t) ( ((uint16_t) (x) << 8u) | ((uint16_t) (x) >> 8u) ) )
+    #define MELO_BSWAP32(x)            ( (((uint32_t) (x)) << 24u) | ((((uint32_t) (x)) & 0x0000FF00ul) << 8u) | \
+                                         ((((uint32_t) (x)) & 0x00FF0000ul) >> 8u) | (((uint32_t) (x)) >> 24u) )
+#endif
+
+#if defined(MELO_CFG_INTERRUPTS) && !defined(MELO_CFG_ENTER_CRITICAL) && defined(__AVR__)
+    #include <avr/interrupt.h>
+    #define MELO_CFG_ENTER_CRITICAL()  cli()
+    #define MELO_CFG_EXIT_CRITICAL()   sei()
+#endif
+
+#if defined(MELO_CFG_INTERRUPTS) && ( !defined(MELO_CFG_ENTER_CRITICAL) || !defined(MELO_CFG_EXIT_CRITICAL) )
+    #error "MELO_CFG_INTERRUPTS requires MELO_CFG_ENTER_CRITICAL and MELO_CFG_EXIT_CRITICAL!"
+#endif
+
+#ifndef MELO_CFG_ENTER_CRITICAL
+    #define MELO_CFG_ENTER_CRITICAL()
+#endif
+
+#ifndef MELO_CFG_EXIT_CRITICAL
+    #define MELO_CFG_EXIT_CRITICAL()
+#endif
+
+#ifndef MELO_CFG_ROM
+    #define MELO_CFG_ROM
+#endif
+
+#ifndef MELO_CFG_ROM_READ_BYTE
+    #define MELO_CFG_ROM_READ_BYTE(p)  (*(p))
+#endif
+
+#ifndef MELO_CFG_ROM_READ_WORD
+    #define MELO_CFG_ROM_READ_WORD(p)  (*(p))
+#endif
+
+#ifndef MELO_CFG_ROM_READ_DWORD
+    #define MELO_CFG_ROM_READ_DWORD(p) (*(p))
+#endif
+
+/* The generated state machine tables are placed with MELO_CFG_ROM too; their entries are bytes or words
+   (16-bit pointers on the parts that need MELO_CFG_ROM) */
+#define _STATE_ROM                     MELO_CFG_ROM
+#define _STATE_ROM_READ(type, p)       ( (type) ((sizeof(type) == 1u) ? MELO_CFG_ROM_READ_BYTE(p) : MELO_CFG_ROM_READ_WORD(p)) )
+
+/* The serialized frame length is reported in the wait frame as a single byte */
+#if (MELO_MAX_FRAME_SIZE > 255)
+    #error "MELO_CFG_MAX_DATA_LENGTH is too large!"
+#endif
 
 #ifdef __cplusplus
 } /* extern "C" */
@@ -474,6 +474,12 @@ Serial::SerialImpl::isOpen () const
   return is_open_;
 }
 
+int
+Serial::SerialImpl::getFd () const
+{
+  return is_open_ ? fd_ : -1;
+}
+
 size_t
 Serial::SerialImpl::available ()
 {
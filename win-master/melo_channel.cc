@@ -0,0 +1,420 @@
+/*
+ * Copyright (c) 2015 David Sunshine, <http://sunshin.es>
+ *
+ * This file is part of melo.
+ *
+ * melo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * melo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with melo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#include "melo_channel.h"
+
+using std::lock_guard;
+using std::min;
+using std::mutex;
+using std::promise;
+using std::shared_ptr;
+using std::vector;
+
+using melo::Channel;
+using melo::Response;
+
+/* Read/write subfunction: size code in bits 0-1, write in bit 2 */
+#define CHANNEL_RW_WRITE    0x04u
+
+namespace {
+
+uint8_t
+size_code (uint8_t size)
+{
+  if (size == 4) {
+    return 2;
+  } else if (size == 2) {
+    return 1;
+  } else if (size == 1) {
+    return 0;
+  }
+  throw std::invalid_argument ("Melo values are 1, 2 or 4 bytes");
+}
+
+void
+to_host_order (Response &response)
+{
+  // The slave answers in the byte order of the frame, a value is reversed as
+  // a whole
+  if (response.byte_order != MELO_CFG_PE_ENDIANESS) {
+    std::reverse(response.data.begin(), response.data.end());
+    response.byte_order = MELO_CFG_PE_ENDIANESS;
+  }
+}
+
+// Melo's context pool is shared by every channel
+mutex contexts_mutex;
+
+} // namespace
+
+Channel::Channel ()
+ : ctx_(NULL), last_tick_(clock::now())
+{
+  std::memset(&callbacks_, 0, sizeof(callbacks_));
+  callbacks_.create_pointer   = &Channel::createPointer;
+  callbacks_.transmit_bytes   = &Channel::transmitBytes;
+  callbacks_.request_bytes    = &Channel::requestBytes;
+  callbacks_.receive_response = &Channel::receiveResponse;
+  callbacks_.receive_daq      = &Channel::receiveDaq;
+
+  {
+    lock_guard<mutex> lock(contexts_mutex);
+    ctx_ = MeloInitCtx(&callbacks_, this);
+  }
+  if (ctx_ == NULL) {
+    throw serial::SerialException ("MeloInitCtx, increase MELO_CFG_MAX_CONTEXTS");
+  }
+
+#ifdef MELO_CFG_DIRECT_RESPONSE
+  // The slave can transmit on its own, it need not announce responses
+  MeloSetDirectResponse(ctx_, true);
+#endif
+}
+
+Channel::~Channel ()
+{
+  failAll(melo::aborted);
+  dispatch();
+
+  lock_guard<mutex> lock(contexts_mutex);
+  MeloFreeCtx(ctx_);
+}
+
+std::future<Response>
+Channel::request (uint8_t service, uint8_t subfunction,
+                  const vector<uint8_t> &data, uint32_t timeout_ms,
+                  bool use_crc)
+{
+  shared_ptr<promise<Response> > result(new promise<Response>());
+
+  this->request(service, subfunction, data,
+                [result] (const Response &response) {
+                  result->set_value(response);
+                },
+                timeout_ms, use_crc);
+
+  return result->get_future();
+}
+
+void
+Channel::request (uint8_t service, uint8_t subfunction,
+                  const vector<uint8_t> &data, Callback callback,
+                  uint32_t timeout_ms, bool use_crc)
+{
+  if (data.size() > MELO_CFG_MAX_DATA_LENGTH) {
+    throw std::invalid_argument ("Request data exceeds MELO_CFG_MAX_DATA_LENGTH");
+  }
+  if (service == MELO_SERVICE_TRANSFER) {
+    // Its consecutive and flow control frames would each hold a tag that no
+    // response ever releases
+    throw std::invalid_argument ("Segmented transfers are not supported");
+  }
+
+  Request request;
+  request.service = service;
+  request.subfunction = subfunction;
+  request.data = data;
+  request.use_crc = use_crc;
+  request.callback = callback;
+  request.deadline = clock::now() + std::chrono::milliseconds(timeout_ms);
+
+  // A request that fails right away completes on the link's next poll, so
+  // callbacks only ever run on the thread that serves the link
+  lock_guard<mutex> lock(mutex_);
+  queued_.push_back(request);
+  sendQueued();
+}
+
+std::future<Response>
+Channel::read (uint32_t address, uint8_t size, uint32_t timeout_ms)
+{
+  shared_ptr<promise<Response> > result(new promise<Response>());
+  vector<uint8_t> data(sizeof(address));
+  std::memcpy(&data[0], &address, sizeof(address));
+
+  this->request(MELO_SERVICE_READ_WRITE, size_code(size), data,
+                [result] (const Response &response) {
+                  Response value = response;
+                  to_host_order(value);
+                  result->set_value(value);
+                },
+                timeout_ms);
+
+  return result->get_future();
+}
+
+std::future<Response>
+Channel::write (uint32_t address, uint8_t size, uint32_t value,
+                uint32_t timeout_ms)
+{
+  uint8_t code = size_code(size);
+  vector<uint8_t> data(sizeof(address) + size);
+  std::memcpy(&data[0], &address, sizeof(address));
+
+  // Requests are sent in this host's byte order, the slave converts them
+  if (size == 4) {
+    uint32_t dword = value;
+    std::memcpy(&data[sizeof(address)], &dword, size);
+  } else if (size == 2) {
+    uint16_t word = static_cast<uint16_t>(value);
+    std::memcpy(&data[sizeof(address)], &word, size);
+  } else {
+    data[sizeof(address)] = static_cast<uint8_t>(value);
+  }
+
+  return this->request(MELO_SERVICE_READ_WRITE, code | CHANNEL_RW_WRITE, data,
+                       timeout_ms);
+}
+
+void
+Channel::setDaqHandler (DaqHandler handler)
+{
+  lock_guard<mutex> lock(mutex_);
+  daq_handler_ = handler;
+}
+
+void
+Channel::receiveBytes (const uint8_t *bytes, size_t length)
+{
+  lock_guard<mutex> lock(mutex_);
+
+  // Frames are processed as their bytes arrive, so several responses in one
+  // read cannot overrun the MELO_CFG_RX_FRAME_COUNT receive buffers
+  for (size_t index = 0; index < length; index++) {
+    MeloReceiveByteCtx(ctx_, bytes[index]);
+    MeloBackgroundCtx(ctx_);
+  }
+
+  sendQueued();
+}
+
+void
+Channel::poll (clock::time_point now)
+{
+  lock_guard<mutex> lock(mutex_);
+
+  std::chrono::milliseconds elapsed =
+    std::chrono::duration_cast<std::chrono::milliseconds>(now - last_tick_);
+  last_tick_ += elapsed;
+
+  // Drives the timeouts of Melo's own state machine
+  MeloTickCtx(ctx_, static_cast<uint16_t>(min<int64_t>(elapsed.count(),
+                                                       UINT16_MAX)));
+  MeloBackgroundCtx(ctx_);
+
+  expire(now);
+  sendQueued();
+}
+
+void
+Channel::failAll (result_t result)
+{
+  lock_guard<mutex> lock(mutex_);
+  fail(result);
+}
+
+void
+Channel::dispatch ()
+{
+  vector<std::function<void ()> > completed;
+
+  {
+    lock_guard<mutex> lock(mutex_);
+    completed.swap(completed_);
+  }
+
+  // Outside the lock, so callbacks may send new requests
+  for (size_t index = 0; index < completed.size(); index++) {
+    completed[index]();
+  }
+}
+
+uint8_t *
+Channel::createPointer (MeloContext * const ctx, const uint32_t address)
+{
+  // The host's memory is not served to the slave
+  (void) address;
+  return static_cast<Channel *>(MeloGetUserData(ctx))->scratch_;
+}
+
+void
+Channel::transmitBytes (MeloContext * const ctx, const uint8_t * const bytes,
+                        const uint8_t length)
+{
+  Channel *channel = static_cast<Channel *>(MeloGetUserData(ctx));
+
+  // Exceptions must not unwind through Melo, a lost frame times out instead
+  try {
+    (void) channel->transmit(bytes, length);
+  } catch (std::exception &) {
+  }
+  MeloTransmitCompleteCtx(ctx);
+}
+
+void
+Channel::requestBytes (MeloContext * const ctx, const uint8_t num)
+{
+  // Serial slaves send the response without being clocked
+  (void) num;
+  MeloTransmitCompleteCtx(ctx);
+}
+
+void
+Channel::receiveResponse (MeloContext * const ctx, const uint8_t tag,
+                          const uint8_t service, const uint8_t subfunction,
+                          const uint8_t * const bytes, const uint8_t length,
+                          bool positive, const uint8_t byte_order)
+{
+  Channel *channel = static_cast<Channel *>(MeloGetUserData(ctx));
+  std::map<uint8_t, Request>::iterator found = channel->outstanding_.find(tag);
+
+  if (found != channel->outstanding_.end()) {
+    Response response;
+    response.result = positive ? melo::positive : melo::negative;
+    response.service = service;
+    response.subfunction = subfunction;
+    response.byte_order = byte_order;
+    response.data.assign(bytes, bytes + length);
+
+    channel->completed_.push_back(std::bind(found->second.callback,
+                                            response));
+    channel->outstanding_.erase(found);
+  }
+  // else: an untagged or cancelled request, nobody is waiting for it
+}
+
+void
+Channel::receiveDaq (MeloContext * const ctx, const uint8_t list,
+                     const uint8_t counter, const uint8_t * const bytes,
+                     const uint8_t length)
+{
+  Channel *channel = static_cast<Channel *>(MeloGetUserData(ctx));
+
+  if (channel->daq_handler_) {
+    vector<uint8_t> samples(bytes, bytes + length);
+    channel->completed_.push_back(std::bind(channel->daq_handler_, list,
+                                            counter, samples));
+  }
+}
+
+void
+Channel::sendQueued ()
+{
+  uint8_t frame[UINT8_MAX];
+
+  while (!queued_.empty()) {
+    Request &next = queued_.front();
+    MeloList list;
+    uint8_t tag;
+
+    list.data = next.data.empty() ? NULL : &next.data[0];
+    list.length = static_cast<uint8_t>(next.data.size());
+    list.size = list.length;
+
+    uint8_t length = MeloTaggedRequestBuilder(ctx_, frame, next.service,
+                                              next.subfunction, &list,
+                                              next.use_crc, &tag);
+    if (length == 0) {
+      // MELO_CFG_MAX_OUTSTANDING requests are in flight
+      break;
+    }
+
+    bool written = false;
+    try {
+      written = transmit(frame, length);
+    } catch (std::exception &) {
+      // Completed below, like a write that timed out
+    }
+
+    if (written) {
+      outstanding_[tag] = next;
+    } else {
+      MeloCancelRequest(ctx_, tag);
+      complete(next.callback, melo::io_error, next.service, next.subfunction);
+    }
+
+    queued_.pop_front();
+  }
+}
+
+void
+Channel::expire (clock::time_point now)
+{
+  std::map<uint8_t, Request>::iterator iter = outstanding_.begin();
+
+  while (iter != outstanding_.end()) {
+    if (iter->second.deadline <= now) {
+      // A late response to this tag is dropped by Melo
+      MeloCancelRequest(ctx_, iter->first);
+      complete(iter->second.callback, melo::timeout, iter->second.service,
+               iter->second.subfunction);
+      outstanding_.erase(iter++);
+    } else {
+      ++iter;
+    }
+  }
+
+  std::deque<Request>::iterator queued = queued_.begin();
+
+  while (queued != queued_.end()) {
+    if (queued->deadline <= now) {
+      complete(queued->callback, melo::timeout, queued->service,
+               queued->subfunction);
+      queued = queued_.erase(queued);
+    } else {
+      ++queued;
+    }
+  }
+}
+
+void
+Channel::fail (result_t result)
+{
+  std::map<uint8_t, Request>::iterator iter;
+
+  for (iter = outstanding_.begin(); iter != outstanding_.end(); ++iter) {
+    MeloCancelRequest(ctx_, iter->first);
+    complete(iter->second.callback, result, iter->second.service,
+             iter->second.subfunction);
+  }
+  outstanding_.clear();
+
+  while (!queued_.empty()) {
+    complete(queued_.front().callback, result, queued_.front().service,
+             queued_.front().subfunction);
+    queued_.pop_front();
+  }
+}
+
+void
+Channel::complete (Callback &callback, result_t result, uint8_t service,
+                   uint8_t subfunction)
+{
+  Response response;
+  response.result = result;
+  response.service = service;
+  response.subfunction = subfunction;
+  response.byte_order = MELO_CFG_PE_ENDIANESS;
+
+  completed_.push_back(std::bind(callback, response));
+}
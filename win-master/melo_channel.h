@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2015 David Sunshine, <http://sunshin.es>
+ *
+ * This file is part of melo.
+ *
+ * melo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * melo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with melo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*!
+ * \file melo_channel.h
+ *
+ * Master side of one Melo link: a MeloContext, the tagged requests in flight
+ * and those waiting for a tag. The transport that moves the bytes (a thread
+ * per port in melo::Client, an epoll loop in melo::Reactor) derives from it.
+ */
+
+#ifndef MELO_CHANNEL_H
+#define MELO_CHANNEL_H
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "serial/serial.h"
+#include "melo.h"
+
+namespace melo {
+
+/*!
+ * Outcome of a request.
+ */
+typedef enum {
+  positive = 0, /*!< The slave answered with a positive response */
+  negative,     /*!< The slave answered with a negative response */
+  timeout,      /*!< No response before the request's timeout */
+  io_error,     /*!< The port failed while the request was in flight */
+  aborted       /*!< The channel was destroyed first */
+} result_t;
+
+/*!
+ * Response to a request, data holds the bytes the slave returned.
+ */
+struct Response {
+  result_t result;
+  uint8_t service;
+  uint8_t subfunction;
+  uint8_t byte_order; /*!< Of data, MELO_LITTLE_ENDIAN or MELO_BIG_ENDIAN */
+  std::vector<uint8_t> data;
+};
+
+/*!
+ * Class that builds Melo requests for one link and routes each response to
+ * the caller that made the request.
+ *
+ * Every channel uses one MeloContext, so MELO_CFG_MAX_CONTEXTS limits the
+ * number of channels and MELO_CFG_MAX_OUTSTANDING the requests each keeps on
+ * the link. Further requests wait in the channel until a tag is released.
+ * A channel gives its context back when it is destroyed.
+ */
+class Channel {
+public:
+  typedef std::function<void (const Response &)> Callback;
+  typedef std::function<void (uint8_t list, uint8_t counter,
+                              const std::vector<uint8_t> &samples)> DaqHandler;
+
+  /*! Requests still in flight are aborted. */
+  virtual ~Channel ();
+
+  /*!
+   * Sends a request and returns a future for its response.
+   *
+   * \param service The service ID, e.g. MELO_SERVICE_READ_WRITE. Segmented
+   * transfers (MELO_SERVICE_TRANSFER) are not supported, most of their frames
+   * are sent and answered without a tag.
+   * \param subfunction The subfunction of the service.
+   * \param data The request data, in this host's byte order.
+   * \param timeout_ms Time from now until the request completes with timeout.
+   * \param use_crc Protect the request and its response with a CRC.
+   */
+  std::future<Response>
+  request (uint8_t service, uint8_t subfunction,
+           const std::vector<uint8_t> &data,
+           uint32_t timeout_ms = 1000, bool use_crc = true);
+
+  /*!
+   * Sends a request and calls callback with its response, from the thread
+   * that serves the link. The callback may send further requests.
+   *
+   * \throw std::invalid_argument for MELO_SERVICE_TRANSFER or data longer
+   * than MELO_CFG_MAX_DATA_LENGTH
+   */
+  void
+  request (uint8_t service, uint8_t subfunction,
+           const std::vector<uint8_t> &data, Callback callback,
+           uint32_t timeout_ms = 1000, bool use_crc = true);
+
+  /*!
+   * Reads a value of size 1, 2 or 4 bytes from the slave's memory. The data
+   * of the response is converted to this host's byte order.
+   */
+  std::future<Response>
+  read (uint32_t address, uint8_t size, uint32_t timeout_ms = 1000);
+
+  /*! Writes a value of size 1, 2 or 4 bytes to the slave's memory. */
+  std::future<Response>
+  write (uint32_t address, uint8_t size, uint32_t value,
+         uint32_t timeout_ms = 1000);
+
+  /*!
+   * Sets the handler of the DAQ samples the slave streams on this link, called
+   * like request callbacks. Samples are dropped while no handler is set.
+   */
+  void
+  setDaqHandler (DaqHandler handler);
+
+protected:
+  typedef std::chrono::steady_clock clock;
+
+  /*! \throw serial::SerialException when no MeloContext is left */
+  Channel ();
+
+  /*!
+   * Writes a whole frame to the link. Called with the channel locked, from
+   * any thread that sends a request.
+   *
+   * \return false when the frame could not be written, its request then
+   * completes with io_error.
+   */
+  virtual bool
+  transmit (const uint8_t *bytes, size_t length) = 0;
+
+  /*! Feeds bytes received from the link and sends the requests they unblock. */
+  void
+  receiveBytes (const uint8_t *bytes, size_t length);
+
+  /*! Advances Melo's timers to now, expires requests and sends queued ones. */
+  void
+  poll (clock::time_point now);
+
+  /*! Completes every request in flight or queued with result. */
+  void
+  failAll (result_t result);
+
+  /*! Runs the callbacks of completed requests, never with the channel locked. */
+  void
+  dispatch ();
+
+private:
+  struct Request {
+    uint8_t service;
+    uint8_t subfunction;
+    std::vector<uint8_t> data;
+    bool use_crc;
+    Callback callback;
+    clock::time_point deadline;
+  };
+
+  // Disable copy constructors
+  Channel (const Channel&);
+  Channel& operator=(const Channel&);
+
+  static uint8_t *
+  createPointer (MeloContext * const ctx, const uint32_t address);
+
+  static void
+  transmitBytes (MeloContext * const ctx, const uint8_t * const bytes,
+                 const uint8_t length);
+
+  static void
+  requestBytes (MeloContext * const ctx, const uint8_t num);
+
+  static void
+  receiveResponse (MeloContext * const ctx, const uint8_t tag,
+                   const uint8_t service, const uint8_t subfunction,
+                   const uint8_t * const bytes, const uint8_t length,
+                   bool positive, const uint8_t byte_order);
+
+  static void
+  receiveDaq (MeloContext * const ctx, const uint8_t list,
+              const uint8_t counter, const uint8_t * const bytes,
+              const uint8_t length);
+
+  void
+  sendQueued ();
+
+  void
+  expire (clock::time_point now);
+
+  void
+  fail (result_t result);
+
+  void
+  complete (Callback &callback, result_t result, uint8_t service,
+            uint8_t subfunction);
+
+  MeloCallbacks callbacks_;
+  MeloContext *ctx_;
+
+  std::mutex mutex_;
+  std::deque<Request> queued_;
+  std::map<uint8_t, Request> outstanding_;
+  std::vector<std::function<void ()> > completed_;
+  DaqHandler daq_handler_;
+  clock::time_point last_tick_;
+  uint8_t scratch_[MELO_CFG_MAX_DATA_LENGTH];
+};
+
+} // namespace melo
+
+#endif
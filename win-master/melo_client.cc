@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2015 David Sunshine, <http://sunshin.es>
+ *
+ * This file is part of melo.
+ *
+ * melo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * melo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with melo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include "melo_client.h"
+
+using std::min;
+
+using melo::Client;
+
+Client::Client (serial::Serial &port, uint32_t poll_ms)
+ : port_(port), running_(true)
+{
+  // Wake up regularly to expire requests, whether or not data arrives
+  serial::Timeout timeout = port_.getTimeout();
+  timeout.inter_byte_timeout = serial::Timeout::max();
+  timeout.read_timeout_constant = poll_ms;
+  timeout.read_timeout_multiplier = 0;
+  port_.setTimeout(timeout);
+
+  thread_ = std::thread(&Client::receive, this);
+}
+
+Client::~Client ()
+{
+  running_ = false;
+  thread_.join();
+}
+
+bool
+Client::transmit (const uint8_t *bytes, size_t length)
+{
+  return port_.write(bytes, length) == length;
+}
+
+void
+Client::receive ()
+{
+  uint8_t buffer[UINT8_MAX];
+
+  while (running_) {
+    size_t length = 0;
+    bool failed = false;
+
+    // The first byte waits up to poll_ms, the rest is already buffered
+    try {
+      length = port_.read(buffer, 1);
+      if (length > 0) {
+        length += port_.read(buffer + 1, min(port_.available(),
+                                             sizeof(buffer) - 1));
+      }
+    } catch (std::exception &) {
+      failed = true;
+    }
+
+    receiveBytes(buffer, length);
+
+    if (failed) {
+      failAll(melo::io_error);
+    } else {
+      poll(clock::now());
+    }
+
+    dispatch();
+
+    if (failed) {
+      // e.g. the port was closed, retry after a while
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+  }
+}
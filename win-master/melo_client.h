@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2015 David Sunshine, <http://sunshin.es>
+ *
+ * This file is part of melo.
+ *
+ * melo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * melo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with melo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*!
+ * \file melo_client.h
+ *
+ * Asynchronous Melo master on top of serial::Serial. A receive thread feeds
+ * the port into a Melo channel, requests are tagged so several can be in
+ * flight, and each completes through a future or a callback with its own
+ * timeout. melo::Reactor serves many ports without a thread each.
+ */
+
+#ifndef MELO_CLIENT_H
+#define MELO_CLIENT_H
+
+#include <atomic>
+#include <thread>
+
+#include "melo_channel.h"
+
+namespace melo {
+
+/*!
+ * Melo channel that serves one serial port with its own receive thread.
+ */
+class Client : public Channel {
+public:
+  /*!
+   * Starts the receive thread on an open port.
+   *
+   * \param port The port to the slave, it must outlive the client. Its read
+   * timeout is set to poll_ms, the write timeout is kept and must leave time
+   * to write a frame (a request whose frame is not written fails with
+   * io_error).
+   *
+   * \param poll_ms Longest time the receive thread waits for data before it
+   * checks the request timeouts.
+   *
+   * \throw serial::SerialException when no MeloContext is left
+   */
+  explicit Client (serial::Serial &port, uint32_t poll_ms = 10);
+
+  /*! Stops the receive thread, requests still in flight are aborted. */
+  virtual ~Client ();
+
+protected:
+  virtual bool
+  transmit (const uint8_t *bytes, size_t length);
+
+private:
+  void
+  receive ();
+
+  serial::Serial &port_;
+  std::atomic<bool> running_;
+  std::thread thread_;
+};
+
+} // namespace melo
+
+#endif
@@ -0,0 +1,342 @@
+/*
+ * Copyright (c) 2015 David Sunshine, <http://sunshin.es>
+ *
+ * This file is part of melo.
+ *
+ * melo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * melo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with melo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if defined(__linux__)
+
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "melo_reactor.h"
+
+using std::lock_guard;
+using std::mutex;
+using std::vector;
+
+using serial::IOException;
+using serial::PortNotOpenedException;
+using serial::SerialException;
+
+using melo::Reactor;
+
+/* Bytes a link may hold back before its requests fail, about 40 full frames */
+#define REACTOR_TX_BACKLOG    4096u
+/* Events handled per epoll_wait */
+#define REACTOR_MAX_EVENTS    64
+
+Reactor::Reactor (size_t shards, uint32_t poll_ms)
+ : poll_ms_(poll_ms), running_(true)
+{
+  if (shards == 0) {
+    shards = 1;
+  }
+
+  for (size_t index = 0; index < shards; index++) {
+    std::unique_ptr<Shard> shard(new Shard);
+    epoll_event event;
+
+    shard->epoll_fd = ::epoll_create1 (EPOLL_CLOEXEC);
+    shard->wake_fd = ::eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    // The wake up event is the only one without a link
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+
+    if ((shard->epoll_fd == -1) || (shard->wake_fd == -1) ||
+        (::epoll_ctl (shard->epoll_fd, EPOLL_CTL_ADD, shard->wake_fd, &event) == -1)) {
+      int error = errno;
+
+      if (shard->epoll_fd != -1) {
+        ::close (shard->epoll_fd);
+      }
+      if (shard->wake_fd != -1) {
+        ::close (shard->wake_fd);
+      }
+      for (size_t created = 0; created < shards_.size(); created++) {
+        ::close (shards_[created]->epoll_fd);
+        ::close (shards_[created]->wake_fd);
+      }
+      THROW (IOException, error);
+    }
+
+    shards_.push_back(std::move(shard));
+  }
+
+  for (size_t index = 0; index < shards_.size(); index++) {
+    shards_[index]->thread = std::thread(&Reactor::run, this,
+                                         std::ref(*shards_[index]));
+  }
+}
+
+Reactor::~Reactor ()
+{
+  running_ = false;
+
+  for (size_t index = 0; index < shards_.size(); index++) {
+    uint64_t wake = 1;
+    ssize_t written = ::write (shards_[index]->wake_fd, &wake, sizeof(wake));
+    (void) written;
+    shards_[index]->thread.join();
+  }
+
+  // Aborts the requests of every link
+  links_.clear();
+
+  for (size_t index = 0; index < shards_.size(); index++) {
+    ::close (shards_[index]->epoll_fd);
+    ::close (shards_[index]->wake_fd);
+  }
+}
+
+Reactor::Link &
+Reactor::add (serial::Serial &port)
+{
+  if (!port.isOpen()) {
+    throw PortNotOpenedException ("Reactor::add");
+  }
+
+  lock_guard<mutex> lock(mutex_);
+
+  // Spread the links evenly, a shard's thread serves all of its links
+  Shard *shard = shards_[0].get();
+  for (size_t index = 1; index < shards_.size(); index++) {
+    if (shards_[index]->links.size() < shard->links.size()) {
+      shard = shards_[index].get();
+    }
+  }
+
+  std::unique_ptr<Link> link;
+  try {
+    link.reset(new Link(port, shard->epoll_fd));
+  } catch (SerialException &) {
+    // Only MeloInitCtx makes a channel fail, every context is taken
+    throw SerialException ("Reactor::add (the MeloContext pool is full, "
+                           "increase MELO_CFG_MAX_CONTEXTS)");
+  }
+  epoll_event event;
+
+  event.events = EPOLLIN;
+  event.data.ptr = link.get();
+  if (::epoll_ctl (shard->epoll_fd, EPOLL_CTL_ADD, link->fd_, &event) == -1) {
+    THROW (IOException, errno);
+  }
+
+  {
+    lock_guard<mutex> shard_lock(shard->mutex);
+    shard->links.push_back(link.get());
+  }
+
+  links_.push_back(std::move(link));
+  return *links_.back();
+}
+
+size_t
+Reactor::size () const
+{
+  lock_guard<mutex> lock(mutex_);
+  return links_.size();
+}
+
+void
+Reactor::run (Shard &shard)
+{
+  epoll_event events[REACTOR_MAX_EVENTS];
+  clock::time_point next_poll = clock::now();
+  vector<Link *> links;
+
+  while (running_) {
+    clock::time_point now = clock::now();
+    int timeout = 0;
+
+    if (next_poll > now) {
+      timeout = static_cast<int>(std::chrono::duration_cast<
+        std::chrono::milliseconds>(next_poll - now).count()) + 1;
+    }
+
+    int count = ::epoll_wait (shard.epoll_fd, events, REACTOR_MAX_EVENTS,
+                              timeout);
+    if (count < 0) {
+      // Interrupted by a signal
+      count = 0;
+    }
+
+    for (int index = 0; index < count; index++) {
+      Link *link = static_cast<Link *>(events[index].data.ptr);
+
+      if (link == NULL) {
+        uint64_t wake;
+        ssize_t length = ::read (shard.wake_fd, &wake, sizeof(wake));
+        (void) length;
+        continue;
+      }
+
+      if ((events[index].events & EPOLLIN) != 0) {
+        link->readable();
+      }
+      if ((events[index].events & EPOLLOUT) != 0) {
+        link->writable();
+      }
+      if (((events[index].events & (EPOLLERR | EPOLLHUP)) != 0) ||
+          (link->failed_ != false)) {
+        link->shutdown();
+      }
+
+      link->dispatch();
+    }
+
+    // Timeouts of every link, once per poll_ms however busy the shard is
+    now = clock::now();
+    if (now >= next_poll) {
+      {
+        lock_guard<mutex> lock(shard.mutex);
+        links = shard.links;
+      }
+
+      for (size_t index = 0; index < links.size(); index++) {
+        if (links[index]->failed_ != false) {
+          links[index]->shutdown();
+        }
+        links[index]->poll(now);
+        links[index]->dispatch();
+      }
+
+      next_poll = now + std::chrono::milliseconds(poll_ms_);
+    }
+  }
+}
+
+Reactor::Link::Link (serial::Serial &port, int epoll_fd)
+ : port_(port), fd_(port.getFd()), epoll_fd_(epoll_fd), tx_armed_(false),
+   failed_(false), removed_(false)
+{
+}
+
+serial::Serial &
+Reactor::Link::port ()
+{
+  return port_;
+}
+
+bool
+Reactor::Link::failed () const
+{
+  return failed_;
+}
+
+bool
+Reactor::Link::transmit (const uint8_t *bytes, size_t length)
+{
+  lock_guard<mutex> lock(tx_mutex_);
+
+  if ((failed_ != false) || (tx_.size() + length > REACTOR_TX_BACKLOG)) {
+    return false;
+  }
+
+  tx_.insert(tx_.end(), bytes, bytes + length);
+  flush();
+
+  return failed_ == false;
+}
+
+void
+Reactor::Link::readable ()
+{
+  uint8_t buffer[UINT8_MAX];
+
+  while (true) {
+    ssize_t length = ::read (fd_, buffer, sizeof(buffer));
+
+    if (length > 0) {
+      receiveBytes(buffer, static_cast<size_t>(length));
+      if (static_cast<size_t>(length) < sizeof(buffer)) {
+        // Drained, no need for another read to return EAGAIN
+        break;
+      }
+    } else if ((length < 0) && (errno == EINTR)) {
+      continue;
+    } else {
+      if ((length < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+        failed_ = true;
+      }
+      // else: nothing left, or the end of a hung up port (EPOLLHUP follows)
+      break;
+    }
+  }
+}
+
+void
+Reactor::Link::writable ()
+{
+  lock_guard<mutex> lock(tx_mutex_);
+  flush();
+}
+
+void
+Reactor::Link::flush ()
+{
+  while (!tx_.empty()) {
+    ssize_t written = ::write (fd_, &tx_[0], tx_.size());
+
+    if (written > 0) {
+      tx_.erase(tx_.begin(), tx_.begin() + written);
+    } else if ((written < 0) && (errno == EINTR)) {
+      continue;
+    } else if ((written < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+      break;
+    } else {
+      failed_ = true;
+      tx_.clear();
+    }
+  }
+
+  // Wait for the port to take the rest, only while there is a rest
+  bool arm = !tx_.empty();
+  if ((arm != tx_armed_) && (removed_ == false)) {
+    epoll_event event;
+
+    event.events = arm ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+    event.data.ptr = this;
+    if (::epoll_ctl (epoll_fd_, EPOLL_CTL_MOD, fd_, &event) == 0) {
+      tx_armed_ = arm;
+    } else {
+      failed_ = true;
+    }
+  }
+}
+
+void
+Reactor::Link::shutdown ()
+{
+  {
+    lock_guard<mutex> lock(tx_mutex_);
+
+    if (removed_ == false) {
+      epoll_event event;
+      (void) ::epoll_ctl (epoll_fd_, EPOLL_CTL_DEL, fd_, &event);
+      removed_ = true;
+    }
+    tx_.clear();
+    failed_ = true;
+  }
+
+  failAll(melo::io_error);
+}
+
+#endif // defined(__linux__)
@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2015 David Sunshine, <http://sunshin.es>
+ *
+ * This file is part of melo.
+ *
+ * melo is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * melo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with melo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*!
+ * \file melo_reactor.h
+ *
+ * Serves many serial ports from a few threads (Linux only). Each port is a
+ * melo::Channel whose non-blocking file descriptor is watched by the epoll
+ * loop of one shard, so a master talking to hundreds of slaves does not need
+ * a thread per port like melo::Client. Every link takes one MeloContext, the
+ * master build (SConstruct) provides 512 of them.
+ */
+
+#ifndef MELO_REACTOR_H
+#define MELO_REACTOR_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "melo_channel.h"
+
+namespace melo {
+
+/*!
+ * Class that owns a pool of epoll loops (shards) and the links they serve.
+ *
+ * Every link is served by one shard for its whole life: its bytes are read,
+ * its timeouts checked and its callbacks and DAQ handler run on that shard's
+ * thread. Callbacks must therefore not block, they hold up every link of the
+ * shard. Requests may be sent from any thread.
+ */
+class Reactor {
+public:
+  /*!
+   * Melo channel of one port registered with the reactor.
+   */
+  class Link : public Channel {
+  public:
+    /*! The port of the link. */
+    serial::Serial &
+    port ();
+
+    /*!
+     * True once the port failed (e.g. it was unplugged). The link then stays
+     * out of the epoll loop and its requests complete with io_error.
+     */
+    bool
+    failed () const;
+
+  protected:
+    virtual bool
+    transmit (const uint8_t *bytes, size_t length);
+
+  private:
+    friend class Reactor;
+
+    Link (serial::Serial &port, int epoll_fd);
+
+    void
+    readable ();
+
+    void
+    writable ();
+
+    void
+    flush ();
+
+    void
+    shutdown ();
+
+    serial::Serial &port_;
+    int fd_;
+    int epoll_fd_;
+
+    // Bytes the port did not take yet, locked after the channel
+    std::mutex tx_mutex_;
+    std::vector<uint8_t> tx_;
+    bool tx_armed_;
+
+    std::atomic<bool> failed_;
+    bool removed_;
+  };
+
+  /*!
+   * Starts the shards.
+   *
+   * \param shards Number of epoll threads the links are spread over.
+   *
+   * \param poll_ms Longest time between two checks of the request timeouts
+   * of every link.
+   *
+   * \throw serial::IOException when an epoll instance cannot be created
+   */
+  explicit Reactor (size_t shards = 1, uint32_t poll_ms = 10);
+
+  /*! Stops the shards, requests still in flight are aborted. */
+  virtual ~Reactor ();
+
+  /*!
+   * Registers an open port with the shard that serves the fewest links.
+   *
+   * The port must outlive the reactor and is only read and written by the
+   * reactor from now on. Its timeouts are not used.
+   *
+   * \throw serial::PortNotOpenedException when the port is closed
+   * \throw serial::SerialException when the MeloContext pool is full, the
+   * reactor then serves at most MELO_CFG_MAX_CONTEXTS ports
+   */
+  Link &
+  add (serial::Serial &port);
+
+  /*! Number of registered links. */
+  size_t
+  size () const;
+
+private:
+  typedef std::chrono::steady_clock clock;
+
+  struct Shard {
+    int epoll_fd;
+    int wake_fd;
+    std::thread thread;
+    std::mutex mutex;
+    std::vector<Link *> links;
+  };
+
+  // Disable copy constructors
+  Reactor (const Reactor&);
+  Reactor& operator=(const Reactor&);
+
+  void
+  run (Shard &shard);
+
+  uint32_t poll_ms_;
+  std::atomic<bool> running_;
+  std::vector<std::unique_ptr<Shard> > shards_;
+
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<Link> > links_;
+};
+
+} // namespace melo
+
+#endif
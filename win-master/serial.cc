@@ -101,6 +101,14 @@ Serial::available ()
   return pimpl_->available ();
 }
 
+#if !defined(_WIN32)
+int
+Serial::getFd () const
+{
+  return pimpl_->getFd ();
+}
+#endif
+
 bool
 Serial::waitReadable ()
 {
@@ -86,6 +86,9 @@ public:
   size_t
   available ();
 
+  int
+  getFd () const;
+
   bool
   waitReadable (uint32_t timeout);
 
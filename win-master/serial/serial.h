@@ -219,6 +219,13 @@ public:
   size_t
   available ();
 
+#if !defined(_WIN32)
+  /*! Returns the file descriptor of the open port (non-blocking), e.g. to
+   * wait on many ports with epoll. It is -1 while the port is closed. */
+  int
+  getFd () const;
+#endif
+
   /*! Block until there is serial data to read or read_timeout_constant
    * number of milliseconds have elapsed. The return value is true when
    * the function exits with the port in a readable state, false otherwise
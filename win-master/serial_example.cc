@@ -10,8 +10,10 @@
 #include <unistd.h>
 #endif
 
+#include <memory>
+
 #include "serial/serial.h"
-#include "./../melo/melo.h"
+#include "melo_client.h"
 
 using std::string;
 using std::exception;
@@ -24,102 +26,29 @@ using std::vector;
 
 static char line[LINE_MAX];
 serial::Serial my_serial;//("COM4", 9600, serial::Timeout::simpleTimeout(1000));
+std::unique_ptr<melo::Client> my_client;
 
 void print_header(void);
 unsigned int get_value(void);
 void comm_port(void);
+void print_response(const melo::Response &response);
 
-uint8_t * MeloCreatePointer( const uint32_t address )
-{
-    return ( (uint8_t *) address );
-}
-
-void MeloTransmitBytes( const uint8_t * const bytes, const uint8_t length )
-{
-  size_t bytes_wrote = 0;
-  try {
-    do {
-        bytes_wrote = my_serial.write(bytes, length);
-    } while (bytes_wrote < length);
-  } catch (exception &e) {
-    cerr << "Unhandled Exception: " << e.what() << endl;
-  }
-    if (bytes_wrote >= 0)
-    {
-    size_t index = 0;
-    printf("Wrote: ");
-    for (index = 0; index < length; index++)
-    {
-        printf("0x%X ", bytes[index]);
-    }
-    printf("\n");
-        MeloTransmitComplete();
-    }
-}
-
-void MeloRequestBytes( const uint8_t num )
+void print_response(const melo::Response &response)
 {
-    printf("Requesting %d bytes from channel.\n", num);
-    MeloTransmitComplete();
-}
+    size_t index;
 
-void MeloReceiveResponse( const uint8_t service, const uint8_t subfunction, const uint8_t * const bytes, const uint8_t length, bool postive )
-{
-    uint8_t index;
-    
     printf("Received Response: \n");
-    printf("Positive Response: %d\n", postive);
-    printf("Service:           %d\n", service);
-    printf("Subfunction:       %d\n", subfunction);
+    printf("Result:            %d\n", response.result);
+    printf("Service:           %d\n", response.service);
+    printf("Subfunction:       %d\n", response.subfunction);
     printf("Bytes:             ");
-    for (index = 0; index < length; index++)
+    for (index = 0; index < response.data.size(); index++)
     {
-        printf("0x%X ", bytes[index]);
+        printf("0x%X ", response.data[index]);
     }
     printf("\n");
 }
 
-uint8_t MeloReadMemoryByAddress(uint8_t * buffer, const uint32_t address, const bool use_crc)
-{
-    MeloList request;
-    uint8_t  data[4];
-    
-    request.data   = data;
-    request.length = 4;
-    
-    /* Always this format - endianess/byte order is automatically accounted for! */
-    data[0] = (address      ) & 0xFF;
-    data[1] = (address >> 8 ) & 0xFF;
-    data[2] = (address >> 16) & 0xFF;
-    data[3] = (address >> 24) & 0xFF;
-   
-    
-    return MeloServiceRequestBuilder(buffer, 0, 0, &request, use_crc);
-}
-
-uint8_t MeloWriteMemoryByAddress(uint8_t * buffer, const uint32_t address, const uint32_t value, const bool use_crc)
-{
-    MeloList request;
-    uint8_t  data[5];
-    
-    request.data   = data;
-    request.length = 5;
-    
-    /* Always this format - endianess/byte order is automatically accounted for! */
-    data[0] = (address      ) & 0xFF;
-    data[1] = (address >> 8 ) & 0xFF;
-    data[2] = (address >> 16) & 0xFF;
-    data[3] = (address >> 24) & 0xFF;
-    
-    data[4] = (value        ) & 0xFF;
-    //data[5] = (value   >> 8 ) & 0xFF;
-    //data[6] = (value   >> 16) & 0xFF;
-    //data[7] = (value   >> 24) & 0xFF;
-   
-    
-    return MeloServiceRequestBuilder(buffer, 0, 4, &request, use_crc);
-}
-
 void print_header(void)
 {
     printf("-- Options --\n");
@@ -165,14 +94,25 @@ void comm_port(void)
             {
                 printf("Initializing %s ...\n", device.port.c_str());
                 
+                my_serial.close();
                 my_serial.setPort(device.port.c_str());
                 my_serial.setBaudrate(9600);
-                my_serial.setTimeout( serial::Timeout::simpleTimeout(1000) );
+                if (!my_client)
+                {
+                    serial::Timeout timeout = serial::Timeout::simpleTimeout(1000);
+                    my_serial.setTimeout( timeout );
+                }
                 my_serial.open();
                 
                 if(my_serial.isOpen())
                 {
                     printf("Serial port opened\n");
+
+                    /* Sets the port's read timeout, and keeps using the port when it is reopened */
+                    if (!my_client)
+                    {
+                        my_client.reset(new melo::Client(my_serial));
+                    }
                 }
                 else
                 {
@@ -211,12 +151,6 @@ int main(int argc, char** argv)
     unsigned int address;
     unsigned int value;
 
-    uint8_t tx_frame_buffer[30];
-    uint8_t rx_frame_buffer[30];
-    uint8_t frame_length;
-
-    MeloInit();
-
     print_header();
 
     printf("> ");
@@ -232,15 +166,14 @@ int main(int argc, char** argv)
             printf("Memory address (HEX):  ");
             address = get_value();
 
-            frame_length = MeloReadMemoryByAddress( &(tx_frame_buffer[0]), (uint32_t) address, false);
-            MeloTransmitBytes(tx_frame_buffer, frame_length);
-            my_serial.read(rx_frame_buffer, frame_length + 6);
-            MeloReceiveBytes(rx_frame_buffer, frame_length + 6);
-
-            MeloBackground();
-            MeloBackground();
-            MeloBackground();
-            MeloBackground();
+            if (my_client)
+            {
+                print_response( my_client->read((uint32_t) address, 1).get() );
+            }
+            else
+            {
+                printf("Configure the comm port first (c)\n");
+            }
         }
         else if (cmd == '1')
         {
@@ -250,15 +183,14 @@ int main(int argc, char** argv)
             printf("Value to write (HEX):  ");
             value   = get_value();
 
-            frame_length = MeloWriteMemoryByAddress( &(tx_frame_buffer[0]), (uint32_t) address, (uint32_t) value, false );
-            MeloTransmitBytes(tx_frame_buffer, frame_length);
-            my_serial.read(rx_frame_buffer, frame_length + 6);
-            MeloReceiveBytes(rx_frame_buffer, frame_length + 6);
-
-            MeloBackground();
-            MeloBackground();
-            MeloBackground();
-            MeloBackground();
+            if (my_client)
+            {
+                print_response( my_client->write((uint32_t) address, 1, (uint32_t) value).get() );
+            }
+            else
+            {
+                printf("Configure the comm port first (c)\n");
+            }
         }
         else if ( (cmd == '?') || (cmd == '\n') )
         {
@@ -280,5 +212,7 @@ int main(int argc, char** argv)
         printf("> ");
     }
 
+    my_client.reset();
+
     return 0;
 }